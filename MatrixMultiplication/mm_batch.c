@@ -0,0 +1,134 @@
+/*
+ * mm_batch.c
+ *
+ * Batched multiplication: many independent small products, such as
+ * 8x8 to 64x64, in one call.  The products are spread over the OpenMP
+ * threads whole, one per iteration, so none of them is split and each
+ * runs on data that fits in L1.
+ *
+ * Packing costs as much as the product itself at these sizes, so the
+ * common widths 8, 16, 32 and 64 get kernels of their own that work on
+ * the matrices in place.  With the width a compile time constant, a row
+ * of c is accumulated in registers over the whole k loop and the loop
+ * along the row is vectorized and unrolled completely:
+ *
+ *	for i = 0 .. m-1
+ *	    t = 0				N accumulators, in registers
+ *	    for p = 0 .. k-1
+ *	        t += a(i,p) * b(p, 0..N-1)	N/V vector FMAs
+ *	    c(i, 0..N-1) = t
+ *
+ * Every width is compiled twice, portably and for AVX2, and the AVX2
+ * version is used whenever the leaf kernel is (see LeafKernel()).  Other
+ * widths go through LeafMult().
+ *
+ * Operands come either as arrays of views, which may all differ in
+ * shape, or as one view per operand and the distance between
+ * consecutive matrices, the strided batch layout of equally shaped
+ * matrices stored back to back.
+ */
+
+#include <string.h>
+#include <omp.h>
+#include "mm_batch.h"
+
+typedef void (*smallmult)(matrix, matrix, accmatrix);
+
+/* c = a*b for matrices with N columns of b and c, with attributes attr */
+#define SMALLMULT(attr, name, N) \
+attr static void name(matrix a, matrix b, accmatrix c) \
+{ \
+	int i, j, p; \
+ \
+	for (i = 0; i < c.rows; i++) { \
+		acc t[N] = {0}, *restrict r = ROW(c, i); \
+		const elem *restrict s = ROW(a, i); \
+ \
+		for (p = 0; p < a.cols; p++) { \
+			acc aip = s[p]; \
+			const elem *restrict q = ROW(b, p); \
+ \
+			_Pragma("omp simd") \
+			for (j = 0; j < N; j++) \
+				t[j] += aip * q[j]; \
+		} \
+		for (j = 0; j < N; j++) \
+			r[j] = t[j]; \
+	} \
+}
+
+#define AVX2 __attribute__((target("avx2,fma")))
+
+SMALLMULT(, mult8, 8)
+SMALLMULT(, mult16, 16)
+SMALLMULT(, mult32, 32)
+SMALLMULT(, mult64, 64)
+SMALLMULT(AVX2, avx2mult8, 8)
+SMALLMULT(AVX2, avx2mult16, 16)
+SMALLMULT(AVX2, avx2mult32, 32)
+SMALLMULT(AVX2, avx2mult64, 64)
+
+/* kernels for the widths 8, 16, 32 and 64 */
+static const smallmult portable[4] = { mult8, mult16, mult32, mult64 };
+static const smallmult avx2[4] = { avx2mult8, avx2mult16, avx2mult32, avx2mult64 };
+static const smallmult *kernels;
+
+/* kernel for products with n columns */
+static smallmult smallkernel(int n)
+{
+	if (kernels == NULL)
+		kernels = strncmp(LeafKernel(), "avx2", 4) ? portable : avx2;
+	switch (n) {
+	case 8:
+		return kernels[0];
+	case 16:
+		return kernels[1];
+	case 32:
+		return kernels[2];
+	case 64:
+		return kernels[3];
+	default:
+		return LeafMult;
+	}
+}
+
+/* c[i] = a[i]*b[i] for i < count, each operand its own view */
+void BatchMult(int count, const matrix *a, const matrix *b, const accmatrix *c)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		check(a[i].cols == b[i].rows && a[i].rows == c[i].rows
+			&& b[i].cols == c[i].cols, "BatchMult: nonconformant matrices");
+	smallkernel(0);
+
+	#pragma omp parallel for schedule(dynamic, 16)
+	for (i = 0; i < count; i++)
+		smallkernel(c[i].cols)(a[i], b[i], c[i]);
+}
+
+/*
+ * c[i] = a[i]*b[i] for i < count, where a[i] is the view a moved by
+ * i*stridea elements, and likewise for b and c
+ */
+void StridedBatchMult(int count, matrix a, size_t stridea, matrix b,
+	size_t strideb, accmatrix c, size_t stridec)
+{
+	smallmult mult;
+	int i;
+
+	check(a.cols == b.rows && a.rows == c.rows && b.cols == c.cols,
+		"StridedBatchMult: nonconformant matrices");
+	mult = smallkernel(c.cols);
+
+	#pragma omp parallel for schedule(static)
+	for (i = 0; i < count; i++) {
+		matrix ai = a, bi = b;
+		accmatrix ci = c;
+
+		ai.d += i * stridea;
+		bi.d += i * strideb;
+		ci.d += i * stridec;
+		mult(ai, bi, ci);
+	}
+}
@@ -0,0 +1,29 @@
+/*
+ * mm_batch.h
+ *
+ * Header file for the batched multiplication of many small matrices.
+ */
+
+#ifndef MM_BATCH_H
+#define MM_BATCH_H
+
+#include "mm_kernel.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* c[i] = a[i]*b[i] for i < count, each operand its own view */
+void BatchMult(int, const matrix *, const matrix *, const accmatrix *);
+
+/*
+ * c[i] = a[i]*b[i] for i < count, where all a[i] have the shape of a
+ * and start stridea elements apart, and likewise for b and c
+ */
+void StridedBatchMult(int, matrix, size_t, matrix, size_t, accmatrix, size_t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MM_BATCH_H */
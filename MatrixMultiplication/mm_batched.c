@@ -0,0 +1,114 @@
+/*
+ * mm_batched.c
+ *
+ * Driver for the batched multiplication of mm_batch.c: count
+ * independent products of the given size in one call, with the
+ * operands stored back to back (strided) or allocated one by one and
+ * passed as arrays of views (array).  Both layouts draw the same random
+ * operands, so their results are the same.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <omp.h>
+#include "mm_batch.h"
+#include "mm_file.h"
+
+int main(int argc, char **argv) {
+	struct timeval ts,tf;
+	double tt;
+	int i, j, m, k, n, opt, count = 1000, strided = 1;
+	char size[40], name[64];
+	matrix a, b, *as, *bs;
+	accmatrix c, *cs;
+
+	while ((opt = getopt(argc, argv, "a:c:")) != -1) {
+		switch (opt) {
+		case 'a':
+			if (!strcmp(optarg, "array"))
+				strided = 0;
+			else
+				check(!strcmp(optarg, "strided"), "main: Unknown layout");
+			break;
+		case 'c':
+			count = atoi(optarg);
+			break;
+		default:
+			check(0, "main: usage: batched [-a strided|array] [-c count] size");
+		}
+	}
+	check(argc - optind >= 1, "main: Need matrix size on command line");
+	check(count > 0, "main: Batch count must be positive");
+	parsesize(argv[optind], &m, &k, &n);
+	sizename(size, m, k, n);
+
+	if (strided) {
+		/* the batch of a is one count*m by k matrix, and so on */
+		a = newmatrix(count * m, k);
+		b = newmatrix(count * k, n);
+		c = newaccmatrix(count * m, n);
+		randomfill(a, SEEDA);
+		randomfill(b, SEEDB);
+	}
+	else {
+		as = malloc(count * sizeof(matrix));
+		bs = malloc(count * sizeof(matrix));
+		cs = malloc(count * sizeof(accmatrix));
+		check(as != NULL && bs != NULL && cs != NULL, "main: out of space for batch");
+		for (i = 0; i < count; i++) {
+			as[i] = newmatrix(m, k);
+			bs[i] = newmatrix(k, n);
+			cs[i] = newaccmatrix(m, n);
+		}
+		for (i = 0; i < count; i++) {
+			randomblock(as[i], SEEDA, (long)i * m, 0);
+			randomblock(bs[i], SEEDB, (long)i * k, 0);
+		}
+	}
+
+	gettimeofday(&ts,NULL);
+	if (strided)
+		StridedBatchMult(count, submatrix(a, 0, 0, m, k), (size_t)m * a.ld,
+			submatrix(b, 0, 0, k, n), (size_t)k * b.ld,
+			accsubmatrix(c, 0, 0, m, n), (size_t)m * c.ld);
+	else
+		BatchMult(count, as, bs, cs);
+	gettimeofday(&tf,NULL);
+	tt=(tf.tv_sec-ts.tv_sec)+(tf.tv_usec-ts.tv_usec)*0.000001;
+
+	printf("Batched Size %s Count %d Layout %s Threads %d Time %lf\n",
+		size,count,strided ? "strided" : "array",omp_get_max_threads(),tt);
+
+	/* the results of either layout as one count*m by n matrix */
+	sprintf(name,"%s_%d",size,count);
+	if (strided)
+		writeresult(c,"batched",name);
+	else {
+		c = newaccmatrix(count * m, n);
+		for (i = 0; i < count; i++)
+			for (j = 0; j < m; j++)
+				memcpy(ROW(c, i * m + j), ROW(cs[i], j), n * sizeof(acc));
+		writeresult(c,"batched",name);
+		freeaccmatrix(c);
+	}
+
+	if (strided) {
+		freematrix(a);
+		freematrix(b);
+		freeaccmatrix(c);
+	}
+	else {
+		for (i = 0; i < count; i++) {
+			freematrix(as[i]);
+			freematrix(bs[i]);
+			freeaccmatrix(cs[i]);
+		}
+		free(as);
+		free(bs);
+		free(cs);
+	}
+	return 0;
+}
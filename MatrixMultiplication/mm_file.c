@@ -0,0 +1,469 @@
+/*
+ * mm_file.c
+ *
+ * Binary matrix files, see mm_file.h for the format.  Files are
+ * written and read through mmap: writing copies the rows of a matrix
+ * into the mapping, in parallel, and reading maps the file privately
+ * and hands out a view of the mapping itself, so that a loaded matrix
+ * costs no copy at all.  The checksum is verified on every read.
+ *
+ * The programs write their result in this format by default, to
+ * res_mm_<algorithm>_<size>.mm.  The environment variable MM_OUTPUT
+ * selects "morton" for the same file in Morton order, with tiles of
+ * resulttile, "text" for the former text dump to
+ * res_mm_<algorithm>_<size>, or "none" to write nothing.
+ *
+ * The programs read their operands from files named with -A and -B
+ * instead of drawing random ones.  readmatrix() takes binary files in
+ * either layout as well as text, one row per line as the text output
+ * has it, from a file or from standard input ("-").  A row-major file
+ * is used as mapped; Morton files are converted, unless recursive
+ * -a morton maps them itself, and text is parsed line by line as it is
+ * read into a new matrix.  freeoperand() releases either kind.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <complex.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mm_file.h"
+
+#define MAXMAPPED 16
+
+int resulttile = 64;
+
+/* views of row-major files handed out by readmatrix() */
+static elem *mapped[MAXMAPPED];
+
+/* size in bytes of the element type dtype */
+static size_t typesize(int dtype)
+{
+	switch (dtype) {
+	case MM_F64:
+	case MM_C64:
+		return 8;
+	case MM_F32:
+	case MM_I32:
+		return 4;
+	case MM_I8:
+		return 1;
+	case MM_C128:
+		return 16;
+	default:
+		check(0, "typesize: unknown element type");
+		return 0;
+	}
+}
+
+/* the 64-bit finalizer of splitmix64 */
+static inline uint64_t mix(uint64_t x)
+{
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+/*
+ * Checksum of n bytes at p: the sum of the mixed 8-byte words, each
+ * combined with its index first, so that the sum depends on the order
+ * of the words yet adds up in any order, and so in parallel.
+ */
+uint64_t checksum(const void *p, size_t n)
+{
+	const unsigned char *b = p;
+	size_t i, words = n / 8;
+	uint64_t s = n, w;
+
+	#pragma omp parallel for reduction(+:s) private(w) schedule(static)
+	for (i = 0; i < words; i++) {
+		memcpy(&w, b + 8 * i, 8);
+		s += mix(w ^ i * 0x9e3779b97f4a7c15ULL);
+	}
+	if (n % 8 != 0) {
+		w = 0;
+		memcpy(&w, b + 8 * words, n % 8);
+		s += mix(w ^ words * 0x9e3779b97f4a7c15ULL);
+	}
+	return s;
+}
+
+/* header of a file of rows by cols elements of type dtype */
+static mmheader header(int dtype, int layout, int rows, int cols)
+{
+	mmheader h;
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, MMMAGIC, sizeof(h.magic));
+	h.version = MMVERSION;
+	h.dtype = dtype;
+	h.layout = layout;
+	h.rows = rows;
+	h.cols = cols;
+	return h;
+}
+
+/*
+ * Write header h and the data to file, the data being rows pieces of
+ * size bytes each, stride bytes apart at src.
+ */
+static void writefile(char *file, mmheader h, const char *src, size_t rows,
+	size_t size, size_t stride)
+{
+	size_t i, len = sizeof(mmheader) + rows * size;
+	char *map;
+	int fd;
+
+	fd = open(file, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	check(fd >= 0, "writefile: cannot create matrix file");
+	check(ftruncate(fd, len) == 0, "writefile: cannot extend matrix file");
+	map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	check(map != MAP_FAILED, "writefile: cannot map matrix file");
+	close(fd);
+
+	#pragma omp parallel for schedule(static)
+	for (i = 0; i < rows; i++)
+		memcpy(map + sizeof(mmheader) + i * size, src + i * stride, size);
+	h.checksum = checksum(map + sizeof(mmheader), rows * size);
+	memcpy(map, &h, sizeof(h));
+	check(munmap(map, len) == 0, "writefile: cannot write matrix file");
+}
+
+/*
+ * Map file privately, check that it holds elements of type dtype in
+ * the given layout and that its checksum is right, and return the
+ * mapping, whose header is copied to h.  The grid of a Morton file
+ * must be the one newzmatrix() makes for its dimensions and tile, so
+ * that its size is known to fit before it is computed.
+ */
+static char *mapfile(char *file, int dtype, int layout, mmheader *h)
+{
+	struct stat st;
+	size_t size;
+	char *map;
+	int fd;
+
+	fd = open(file, O_RDONLY);
+	check(fd >= 0, "mapfile: cannot open matrix file");
+	check(fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(mmheader),
+		"mapfile: not a matrix file");
+	map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	check(map != MAP_FAILED, "mapfile: cannot map matrix file");
+	close(fd);
+
+	memcpy(h, map, sizeof(*h));
+	check(!memcmp(h->magic, MMMAGIC, sizeof(h->magic)) && h->version == MMVERSION,
+		"mapfile: not a matrix file");
+	check(h->dtype == (uint32_t)dtype, "mapfile: element type differs from this program's");
+	check(h->layout == (uint32_t)layout, "mapfile: unexpected layout");
+	check(h->rows > 0 && h->cols > 0 && h->rows <= INT_MAX && h->cols <= INT_MAX,
+		"mapfile: invalid matrix dimensions");
+	if (layout == MM_MORTON) {
+		check(h->tile > 0 && h->tile <= INT_MAX
+			&& h->rlevels == (uint32_t)mortonlevels(h->rows, h->tile)
+			&& h->clevels == (uint32_t)mortonlevels(h->cols, h->tile),
+			"mapfile: invalid Morton grid");
+		size = (size_t)h->tile * h->tile;
+		check(size <= SIZE_MAX / typesize(dtype) >> (h->rlevels + h->clevels),
+			"mapfile: matrix too large");
+		size <<= h->rlevels + h->clevels;
+	}
+	else {
+		size = h->rows * h->cols;
+		check(size <= SIZE_MAX / typesize(dtype), "mapfile: matrix too large");
+	}
+	size *= typesize(dtype);
+	check((size_t)st.st_size == sizeof(mmheader) + size, "mapfile: matrix file truncated");
+	check(checksum(map + sizeof(mmheader), size) == h->checksum,
+		"mapfile: checksum mismatch");
+	return map;
+}
+
+/* write a to file in row-major order */
+void writematrix(matrix a, char *file)
+{
+	writefile(file, header(ELEMTYPE, MM_ROWMAJOR, a.rows, a.cols), (char *)a.d,
+		a.rows, a.cols * sizeof(elem), a.ld * sizeof(elem));
+}
+
+#ifdef MM_INT8
+void writeaccmatrix(accmatrix a, char *file)
+{
+	writefile(file, header(ACCTYPE, MM_ROWMAJOR, a.rows, a.cols), (char *)a.d,
+		a.rows, a.cols * sizeof(acc), a.ld * sizeof(acc));
+}
+#endif
+
+/* write z to file in Morton order */
+void writezmatrix(zmatrix z, char *file)
+{
+	mmheader h = header(ELEMTYPE, MM_MORTON, z.rows, z.cols);
+
+	h.tile = z.tile;
+	h.rlevels = z.rlevels;
+	h.clevels = z.clevels;
+	writefile(file, h, (char *)z.d, (size_t)1 << (z.rlevels + z.clevels),
+		ZSIZE(z, 0, 0) * sizeof(elem), ZSIZE(z, 0, 0) * sizeof(elem));
+}
+
+/*
+ * Matrix of a row-major file.  The matrix is a view of the mapping
+ * without the padding of newmatrix(), ld = cols; it may be written to
+ * without changing the file.
+ */
+matrix mapmatrix(char *file)
+{
+	mmheader h;
+	char *map = mapfile(file, ELEMTYPE, MM_ROWMAJOR, &h);
+	matrix a;
+
+	a.d = (elem *)(map + sizeof(mmheader));
+	a.rows = h.rows;
+	a.cols = a.ld = h.cols;
+	return a;
+}
+
+/* zmatrix of a Morton file, a view of the mapping as above */
+zmatrix mapzmatrix(char *file)
+{
+	mmheader h;
+	char *map = mapfile(file, ELEMTYPE, MM_MORTON, &h);
+	zmatrix z;
+
+	z.d = (elem *)(map + sizeof(mmheader));
+	z.rows = h.rows;
+	z.cols = h.cols;
+	z.tile = h.tile;
+	z.rlevels = h.rlevels;
+	z.clevels = h.clevels;
+	return z;
+}
+
+void unmapmatrix(matrix a)
+{
+	check(a.ld == a.cols, "unmapmatrix: not a mapped matrix");
+	munmap((char *)a.d - sizeof(mmheader),
+		sizeof(mmheader) + (size_t)a.rows * a.cols * sizeof(elem));
+}
+
+void unmapzmatrix(zmatrix z)
+{
+	munmap((char *)z.d - sizeof(mmheader),
+		sizeof(mmheader) + ZSIZE(z, z.rlevels, z.clevels) * sizeof(elem));
+}
+
+/*
+ * Write the result c of algorithm for the given size, as MM_OUTPUT
+ * says: in binary to res_mm_<algorithm>_<size>.mm by default, row-major
+ * or in Morton order, as text to res_mm_<algorithm>_<size>, or not at
+ * all.
+ */
+void writeresult(accmatrix c, char *algorithm, char *size)
+{
+	char *mode = getenv("MM_OUTPUT"), file[128];
+	FILE *f;
+#ifndef MM_INT8
+	zmatrix z;
+#endif
+
+	if (mode != NULL && !strcmp(mode, "none"))
+		return;
+	if (mode != NULL && !strcmp(mode, "text")) {
+		snprintf(file, sizeof(file), "res_mm_%s" ELEMSUFFIX "_%s", algorithm, size);
+		f = fopen(file, "w");
+		check(f != NULL, "writeresult: cannot create result file");
+		printacc(c, f);
+		fclose(f);
+		return;
+	}
+	snprintf(file, sizeof(file), "res_mm_%s" ELEMSUFFIX "_%s.mm", algorithm, size);
+	if (mode != NULL && !strcmp(mode, "morton")) {
+#ifdef MM_INT8
+		check(0, "writeresult: no Morton files of int8 results");
+#else
+		z = newzmatrix(c.rows, c.cols, resulttile);
+		tomorton(c, z);
+		writezmatrix(z, file);
+		freezmatrix(z);
+#endif
+		return;
+	}
+	check(mode == NULL || !strcmp(mode, "binary"),
+		"writeresult: MM_OUTPUT must be binary, morton, text or none");
+	writeaccmatrix(c, file);
+}
+
+/*
+ * Matrix of a binary file with the given layout: the mapping itself
+ * for a row-major file, a new matrix converted from a Morton one.
+ */
+static matrix readbinary(char *file, int layout)
+{
+	matrix a;
+	zmatrix z;
+	int i;
+
+	if (layout == MM_MORTON) {
+		z = mapzmatrix(file);
+		a = newmatrix(z.rows, z.cols);
+		frommorton(z, a);
+		unmapzmatrix(z);
+		return a;
+	}
+	for (i = 0; i < MAXMAPPED && mapped[i] != NULL; i++)
+		;
+	check(i < MAXMAPPED, "readbinary: too many mapped matrix files");
+	a = mapmatrix(file);
+	mapped[i] = a.d;
+	return a;
+}
+
+/* parse one element of text at s into x, return its end or NULL */
+static char *parse(char *s, elem *x)
+{
+	char *e;
+#if defined(MM_COMPLEX)
+	double re = strtod(s, &e), im;
+
+	if (e == s)
+		return NULL;
+	im = strtod(s = e, &e);
+	if (e == s || *e != 'i' || (*s != '+' && *s != '-')) {
+		*x = re;	/* a real element */
+		return s;
+	}
+	*x = re + im * I;
+	return e + 1;
+#elif defined(MM_INT8)
+	long v = strtol(s, &e, 10);
+
+	if (e == s || v < -128 || v > 127)
+		return NULL;
+	*x = v;
+	return e;
+#else
+	*x = strtod(s, &e);
+	return e == s ? NULL : e;
+#endif
+}
+
+/* is s blank to its end? */
+static int blank(char *s)
+{
+	return s[strspn(s, " \t\r")] == 0;
+}
+
+/*
+ * New matrix of a text file, parsed a line at a time as it is read.
+ * The matrix grows by doubling its rows as lines come in.
+ */
+static matrix readtext(char *file)
+{
+	FILE *f = strcmp(file, "-") ? fopen(file, "r") : stdin;
+	char *line = NULL, *p;
+	size_t len = 0;
+	int rows = 0, cols = 0, j;
+	elem x;
+	matrix a, g;
+
+	check(f != NULL, "readtext: cannot open matrix file");
+	a.d = NULL;
+	while (getline(&line, &len, f) != -1) {
+		line[strcspn(line, "\n")] = 0;
+		if (blank(line))
+			continue;
+		if (a.d == NULL) {
+			for (p = line; (p = parse(p, &x)) != NULL; cols++)
+				;
+			check(cols > 0, "readtext: no matrix in file");
+			a = newmatrix(64, cols);
+		}
+		if (rows == a.rows) {
+			check(rows <= INT_MAX / 2, "readtext: too many rows in matrix file");
+			g = newmatrix(2 * rows, cols);
+			memcpy(g.d, a.d, (size_t)rows * a.ld * sizeof(elem));
+			freematrix(a);
+			a = g;
+		}
+		for (p = line, j = 0; j < cols && p != NULL; j++)
+			p = parse(p, ROW(a, rows) + j);
+		check(p != NULL && blank(p),
+			"readtext: invalid element or rows of different lengths");
+		rows++;
+	}
+	check(!ferror(f), "readtext: cannot read matrix file");
+	if (f != stdin)
+		fclose(f);
+	free(line);
+	check(rows > 0, "readtext: no matrix in file");
+	a.rows = rows;
+	return a;
+}
+
+/* read the header of file into h, return whether it is a binary file */
+static int readheader(char *file, mmheader *h)
+{
+	FILE *f;
+	size_t n = 0;
+
+	if (strcmp(file, "-") && (f = fopen(file, "r")) != NULL) {
+		n = fread(h, 1, sizeof(*h), f);
+		fclose(f);
+	}
+	return n == sizeof(*h) && !memcmp(h->magic, MMMAGIC, sizeof(h->magic));
+}
+
+/*
+ * Matrix read from file, a binary matrix file in either layout or a
+ * text one; "-" reads text from standard input.  The matrix of a
+ * row-major file is a view of its mapping, see mapmatrix(), the others
+ * are new; freeoperand() frees both.
+ */
+matrix readmatrix(char *file)
+{
+	mmheader h;
+
+	if (readheader(file, &h))
+		return readbinary(file, h.layout);
+	return readtext(file);
+}
+
+/* tile of the Morton grid of a binary file in Morton order, else 0 */
+int mortontile(char *file)
+{
+	mmheader h;
+
+	if (readheader(file, &h) && h.layout == MM_MORTON && h.dtype == ELEMTYPE)
+		return h.tile;
+	return 0;
+}
+
+/* read operands a and b of a product from files fa and fb */
+void readoperands(char *fa, char *fb, matrix *a, matrix *b)
+{
+	check(fa != NULL && fb != NULL, "readoperands: Need both -A and -B");
+	*a = readmatrix(fa);
+	*b = readmatrix(fb);
+	check(a->cols == b->rows, "readoperands: nonconformant matrices");
+}
+
+/* free a matrix of readmatrix() or newmatrix(), unmapping a mapped one */
+void freeoperand(matrix a)
+{
+	int i;
+
+	for (i = 0; i < MAXMAPPED; i++)
+		if (mapped[i] == a.d) {
+			mapped[i] = NULL;
+			unmapmatrix(a);
+			return;
+		}
+	freematrix(a);
+}
@@ -0,0 +1,91 @@
+/*
+ * mm_file.h
+ *
+ * Header file for the binary matrix files.
+ */
+
+#ifndef MM_FILE_H
+#define MM_FILE_H
+
+#include <stdint.h>
+#include "mm_matrix.h"
+#include "mm_morton.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A matrix file is a 64-byte header followed by the elements, in the
+ * byte order of the machine that wrote it.  Row-major data is dense,
+ * rows*cols elements without the padding of the leading dimension;
+ * Morton data is the whole grid of a zmatrix, padding tiles included.
+ * The data starts 64 bytes into the file and so keeps the alignment
+ * of the mapping.
+ */
+
+#define MMMAGIC "MMATRIX"	/* with its terminating 0, 8 bytes */
+#define MMVERSION 2
+
+/* element types */
+enum { MM_F64 = 1, MM_F32, MM_I8, MM_I32, MM_C128, MM_C64 };
+
+/* layouts */
+enum { MM_ROWMAJOR = 1, MM_MORTON };
+
+typedef struct _mmheader {
+	char magic[8];		/* MMMAGIC */
+	uint32_t version;	/* MMVERSION */
+	uint32_t dtype;		/* element type */
+	uint32_t layout;	/* MM_ROWMAJOR or MM_MORTON */
+	uint32_t tile;		/* tile and levels of the Morton grid, else 0 */
+	uint32_t rlevels;
+	uint32_t clevels;
+	uint64_t rows, cols;	/* dimensions */
+	uint64_t checksum;	/* of the data, see checksum() */
+	uint64_t reserved;
+} mmheader;
+
+/* file element type of elem and acc in this build */
+#if defined(MM_COMPLEX) && defined(MM_FLOAT)
+#define ELEMTYPE MM_C64
+#define ACCTYPE MM_C64
+#elif defined(MM_COMPLEX)
+#define ELEMTYPE MM_C128
+#define ACCTYPE MM_C128
+#elif defined(MM_INT8)
+#define ELEMTYPE MM_I8
+#define ACCTYPE MM_I32
+#elif defined(MM_FLOAT)
+#define ELEMTYPE MM_F32
+#define ACCTYPE MM_F32
+#else
+#define ELEMTYPE MM_F64
+#define ACCTYPE MM_F64
+#endif
+
+uint64_t checksum(const void *, size_t);	/* of n bytes */
+void writematrix(matrix, char *);	/* write row-major file */
+void writezmatrix(zmatrix, char *);	/* write Morton file */
+matrix mapmatrix(char *);	/* map row-major file as a matrix */
+zmatrix mapzmatrix(char *);	/* map Morton file as a zmatrix */
+void unmapmatrix(matrix);	/* unmap matrix from mapmatrix */
+void unmapzmatrix(zmatrix);
+void writeresult(accmatrix, char *, char *);	/* result of algorithm, size */
+extern int resulttile;	/* tile of Morton result files, 64 by default */
+matrix readmatrix(char *);	/* matrix of binary or text file */
+int mortontile(char *);	/* tile of Morton file, else 0 */
+void readoperands(char *, char *, matrix *, matrix *);	/* a, b of files */
+void freeoperand(matrix);	/* free matrix of readmatrix or newmatrix */
+
+#ifdef MM_INT8
+void writeaccmatrix(accmatrix, char *);
+#else
+#define writeaccmatrix writematrix
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MM_FILE_H */
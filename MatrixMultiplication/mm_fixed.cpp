@@ -0,0 +1,128 @@
+/*
+ * mm_fixed.cpp
+ *
+ * Leaf products of a fixed size, generated at compile time.  The
+ * recursive engines cut a product whose sizes are powers of two times
+ * block into leaves of exactly block by block, so for the common block
+ * sizes 8, 16, 32 and 64 every leaf has the same shape, as have the
+ * full tiles of the tiled engine.  Mult<N> multiplies one such shape,
+ * with M = K = N, with all loop bounds constant: a is read in place, RB
+ * rows by NB vectors of c are accumulated in registers,
+ *
+ *	for i = 0 .. M-1 step RB
+ *	    for j = 0 .. N-1 step NB*V
+ *	        t = 0					RB x NB vectors
+ *	        for p = 0 .. K-1			unrolled 16 times
+ *	            q = b(p, j..j+NB*V-1)		NB vector loads
+ *	            t += a(i..i+RB-1, p) * q		RB*NB vector FMAs
+ *	        c(i..i+RB-1, j..j+NB*V-1) = t
+ *
+ * and the loops over i and j disappear when M and N are small, leaving
+ * straight-line code without packing.  The k loop is only partly
+ * unrolled, since unrolling all of it, 64 steps deep, is slower as
+ * soon as the code overflows the instruction cache.
+ *
+ * The kernels are compiled for AVX2 and used in place of the packed
+ * leaf whenever that uses the AVX2 micro-kernel, see LeafMult().  The
+ * int8 and complex leaves always go through packing: the int8 one
+ * multiplies pairs of k with one madd, and the complex one needs the
+ * planar panels.
+ */
+
+#include <string.h>
+#include "mm_kernel.h"
+
+#if !defined(MM_INT8) && !defined(MM_COMPLEX)
+
+#define RB 4
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+
+/* c = a*b, or c = c + a*b if Add, for an M by K a and K by N b */
+template <int M, int K, int N, bool Add>
+static void Kernel(matrix a, matrix b, accmatrix c)
+{
+	const int V = 32 / sizeof(acc);			/* elements per ymm register */
+	const int NB = N / V < 2 ? N / V : 2;
+	typedef acc vec __attribute__((vector_size(V * sizeof(acc))));
+
+	static_assert(M % RB == 0 && N % (NB * V) == 0, "Kernel: unsupported shape");
+	for (int i = 0; i < M; i += RB)
+		for (int j = 0; j < N; j += NB * V) {
+			vec t[RB][NB] = {}, q[NB], u;
+
+			#pragma GCC unroll 16
+			for (int p = 0; p < K; p++) {
+				for (int v = 0; v < NB; v++)
+					memcpy(&q[v], ROW(b, p) + j + v * V, sizeof(vec));
+				for (int r = 0; r < RB; r++) {
+					acc x = ELEM(a, i + r, p);
+					for (int v = 0; v < NB; v++)
+						t[r][v] += x * q[v];
+				}
+			}
+			for (int r = 0; r < RB; r++)
+				for (int v = 0; v < NB; v++) {
+					acc *s = ROW(c, i + r) + j + v * V;
+					if (Add) {
+						memcpy(&u, s, sizeof(vec));
+						t[r][v] += u;
+					}
+					memcpy(s, &t[r][v], sizeof(vec));
+				}
+		}
+}
+
+template <int N>
+static void Mult(matrix a, matrix b, accmatrix c)
+{
+	Kernel<N, N, N, false>(a, b, c);
+}
+
+template <int N>
+static void MultAdd(matrix a, matrix b, accmatrix c)
+{
+	Kernel<N, N, N, true>(a, b, c);
+}
+
+#pragma GCC pop_options
+
+template <int N>
+static leafmult square(int add)
+{
+	if (add)
+		return MultAdd<N>;
+	return Mult<N>;
+}
+
+/*
+ * kernel for c = a*b, or c = c + a*b if add, with an m by k a and a k
+ * by n b, or NULL if there is none for this shape
+ */
+leafmult FixedMult(int m, int k, int n, int add)
+{
+	if (m != k || k != n)
+		return NULL;
+	switch (n) {
+	case 8:
+		return square<8>(add);
+	case 16:
+		return square<16>(add);
+	case 32:
+		return square<32>(add);
+	case 64:
+		return square<64>(add);
+	default:
+		return NULL;
+	}
+}
+
+#else
+
+leafmult FixedMult(int m, int k, int n, int add)
+{
+	return NULL;
+}
+
+#endif
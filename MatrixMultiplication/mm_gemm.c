@@ -0,0 +1,174 @@
+/*
+ * mm_gemm.c
+ *
+ * Cache-blocked matrix multiplication in the style of GotoBLAS:
+ *
+ *	for jc = 0 .. n-1 step NC
+ *	    for pc = 0 .. k-1 step KC
+ *	        pack b(pc:pc+KC, jc:jc+NC)		shared, stays in L3
+ *	        for ic = 0 .. m-1 step MC
+ *	            pack a(ic:ic+MC, pc:pc+KC)	per thread, stays in L2
+ *	            macro-kernel			micro-panel of b in L1,
+ *						MR x NR of c in registers
+ *
+ * Packing makes every operand the micro-kernel touches contiguous, so
+ * the inner loops suffer neither TLB nor conflict misses regardless of
+ * n.  The threads pack the b block together and then split the MC
+ * blocks of a among themselves.
+ *
+ * The block sizes come from the cache sizes the C library reports: a
+ * micro-panel of b fills half of L1, a block of a half of L2 and a
+ * block of b half of L3.
+ *
+ * gemm() adds the BLAS semantics c = alpha*op(a)*op(b) + beta*c on top:
+ * transposed operands are read in transposed order while packing, and
+ * beta is applied by the first KC step, alpha by every one, as the
+ * micro-kernels store c.
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <omp.h>
+#include "mm_gemm.h"
+
+#define L1DEFAULT (32 << 10)
+#define L2DEFAULT (256 << 10)
+#define L3DEFAULT (8 << 20)
+#define NCMAX 4096
+
+/* size of a cache as reported by sysconf, or def if unknown */
+static long cachesize(int name, long def)
+{
+	long size = sysconf(name);
+
+	return size > 0 ? size : def;
+}
+
+/* return the block sizes derived from the cache hierarchy */
+blocking CacheBlocking(void)
+{
+	blocking bl;
+	long l1 = cachesize(_SC_LEVEL1_DCACHE_SIZE, L1DEFAULT);
+	long l2 = cachesize(_SC_LEVEL2_CACHE_SIZE, L2DEFAULT);
+	long l3 = cachesize(_SC_LEVEL3_CACHE_SIZE, L3DEFAULT);
+
+	bl.kc = l1 / 2 / (PARTS * NR * sizeof(packed)) / KU * KU;
+	bl.mc = l2 / 2 / (PACKLEN(bl.kc) * sizeof(packed)) / MR * MR;
+	bl.nc = l3 / 2 / (PACKLEN(bl.kc) * sizeof(packed)) / NR * NR;
+	if (bl.mc < MR)
+		bl.mc = MR;
+	if (bl.nc < NR)
+		bl.nc = NR;
+	if (bl.nc > NCMAX)
+		bl.nc = NCMAX;
+	return bl;
+}
+
+static packed *packbuffer(size_t size)
+{
+	void *p = NULL;
+
+	check(posix_memalign(&p, MM_ALIGN, size * sizeof(packed)) == 0,
+		"packbuffer: out of space for packing buffer");
+	return p;
+}
+
+/* rows by cols block at (i,j) of op(a), which is a or its transpose */
+static matrix opblock(matrix a, int trans, int i, int j, int rows, int cols)
+{
+	return trans ? submatrix(a, j, i, cols, rows) : submatrix(a, i, j, rows, cols);
+}
+
+/* c = beta*c, without reading c if beta is zero */
+static void scale(accmatrix c, acc beta)
+{
+	int i, j;
+
+	if (beta == 0) {
+		zeroaccmatrix(c);
+		return;
+	}
+	for (i = 0; i < c.rows; i++) {
+		acc *r = ROW(c, i);
+		for (j = 0; j < c.cols; j++)
+			r[j] *= beta;
+	}
+}
+
+/* c = alpha*op(a)*op(b) + beta*c with cache blocking bl */
+void PackedGemm(int transa, int transb, acc alpha, matrix a, matrix b,
+	acc beta, accmatrix c, blocking bl)
+{
+	int m = c.rows, n = c.cols, k = transa ? a.rows : a.cols;
+	packed *bp;
+
+	if (alpha == 0 || k == 0) {
+		scale(c, beta);
+		return;
+	}
+	/* panels are padded to whole MR rows and NR columns */
+	bp = packbuffer((size_t)(bl.nc + NR - 1) / NR * NR * PACKLEN(bl.kc));
+
+	#pragma omp parallel
+	{
+		packed *ap = packbuffer((size_t)(bl.mc + MR - 1) / MR * MR * PACKLEN(bl.kc));
+		int ic, jc, jr, pc, mc, nc, kc;
+
+		for (jc = 0; jc < n; jc += bl.nc) {
+			nc = n - jc < bl.nc ? n - jc : bl.nc;
+			for (pc = 0; pc < k; pc += bl.kc) {
+				kc = k - pc < bl.kc ? k - pc : bl.kc;
+
+				#pragma omp for schedule(static)
+				for (jr = 0; jr < nc; jr += NR)
+					PackB(opblock(b, transb, pc, jc + jr, kc,
+						nc - jr < NR ? nc - jr : NR),
+						transb, bp + (size_t)jr * PACKLEN(kc));
+
+				#pragma omp for schedule(dynamic)
+				for (ic = 0; ic < m; ic += bl.mc) {
+					mc = m - ic < bl.mc ? m - ic : bl.mc;
+					PackA(opblock(a, transa, ic, pc, mc, kc),
+						transa, ap);
+					MacroKernel(kc, ap, bp, accsubmatrix(c, ic, jc, mc, nc),
+						alpha, pc > 0 ? 1 : beta);
+				}
+			}
+		}
+		free(ap);
+	}
+	free(bp);
+}
+
+/* c = a*b with cache blocking bl */
+void PackedMult(matrix a, matrix b, accmatrix c, blocking bl)
+{
+	PackedGemm(NOTRANS, NOTRANS, 1, a, b, 0, c, bl);
+}
+
+/* operation selected by a BLAS transpose character */
+static int transpose(char t)
+{
+	t = toupper(t);
+	check(t == 'N' || t == 'T' || t == 'C', "gemm: transpose must be 'N', 'T' or 'C'");
+	return t == 'N' ? NOTRANS : t == 'T' ? TRANS : CONJTRANS;
+}
+
+/*
+ * c = alpha*op(a)*op(b) + beta*c, where op(x) is x for 'N', the
+ * transpose of x for 'T' and its conjugate transpose for 'C' (the same
+ * as 'T' for real matrices).  c is
+ * not read when beta is zero, and a and b are not read when alpha is.
+ * The blocking is that of CacheBlocking().
+ */
+void gemm(char transa, char transb, acc alpha, matrix a, matrix b,
+	acc beta, accmatrix c)
+{
+	int ta = transpose(transa), tb = transpose(transb);
+
+	check((ta ? a.cols : a.rows) == c.rows && (tb ? b.rows : b.cols) == c.cols
+		&& (ta ? a.rows : a.cols) == (tb ? b.cols : b.rows),
+		"gemm: nonconformant matrices");
+	PackedGemm(ta, tb, alpha, a, b, beta, c, CacheBlocking());
+}
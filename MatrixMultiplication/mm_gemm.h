@@ -0,0 +1,36 @@
+/*
+ * mm_gemm.h
+ *
+ * Header file for the cache-blocked (GotoBLAS style) multiplication.
+ */
+
+#ifndef MM_GEMM_H
+#define MM_GEMM_H
+
+#include "mm_kernel.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Cache blocking of the packed multiplication: a KC by NC block of b
+ * is kept in L3, an MC by KC block of a in L2, and a KC by NR micro
+ * panel of b in L1.
+ */
+typedef struct _blocking {
+	int mc, kc, nc;
+} blocking;
+
+blocking CacheBlocking(void);		/* block sizes for this machine */
+void PackedMult(matrix, matrix, accmatrix, blocking);	/* c = a*b */
+void PackedGemm(int, int, acc, matrix, matrix, acc, accmatrix, blocking);
+
+/* c = alpha*op(a)*op(b) + beta*c, BLAS style; 'N' or 'T' selects op */
+void gemm(char, char, acc, matrix, matrix, acc, accmatrix);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MM_GEMM_H */
@@ -0,0 +1,510 @@
+/*
+ * mm_kernel.c
+ *
+ * Leaf kernel shared by the tiled, recursive and Strassen engines.
+ *
+ * A leaf product first copies a into panels of MR rows and b into
+ * panels of NR columns, laid out in the order the micro-kernel reads
+ * them:
+ *
+ *	a panel:	a(i..i+MR-1, p) for p = 0..k-1
+ *	b panel:	b(p, j..j+NR-1) for p = 0..k-1
+ *
+ * The micro-kernel then streams one a panel and one b panel with unit
+ * stride and keeps the MR by NR block of c in registers for the whole
+ * k loop.  Panels are zero padded at ragged edges, and the edge blocks
+ * of c go through a small buffer.
+ *
+ * The leaves compute the full c = alpha*op(a)*op(b) + beta*c: packing
+ * reads a and b in transposed order when asked to, and the micro-kernel
+ * applies alpha and beta to the block of c it holds in registers, so
+ * neither transposes nor scaling take a pass of their own.
+ *
+ * Each element type has a portable scalar micro-kernel and one using
+ * AVX2, which holds the block of c in twelve ymm registers:
+ *
+ *	double	6x8, FMA on 4 doubles per register
+ *	float	6x16, FMA on 8 floats per register
+ *	int8	6x16, _mm256_madd_epi16 on pairs of k into 8 int32 sums
+ *		per register
+ *
+ * The int8 panels hold int16 and interleave KU = 2 consecutive values
+ * of k, so that one madd multiplies a pair of a by a pair of b and adds
+ * the two products.  The first leaf picks the AVX2 kernel if the CPU
+ * supports it, unless the environment variable MM_KERNEL is set to
+ * "scalar".
+ *
+ * Complex leaves reuse the real micro-kernels on planar panels, which
+ * hold the real parts, the imaginary parts and their sums separately.
+ * With ar, ai, br, bi the parts of a block of a and b they compute
+ *
+ *	4M:	cr = ar*br - ai*bi		ci = ar*bi + ai*br
+ *	3M:	p1 = ar*br, p2 = ai*bi, p3 = (ar+ai)*(br+bi)
+ *		cr = p1 - p2			ci = p3 - p1 - p2
+ *
+ * so the 3M (Gauss) algorithm does three real products instead of four.
+ * It is the default; MM_CMULT=4m selects the 4M algorithm, which avoids
+ * the small extra rounding error of 3M in the imaginary parts.  Every
+ * engine multiplies its leaves this way, so the level at which 3M takes
+ * over is set by the leaf size: the whole product with block >= n, the
+ * cache blocks with the packed engine.
+ *
+ * LeafMult() and LeafMultAdd() hand the products of the shapes
+ * mm_fixed.cpp has kernels for to those, which skip packing; they
+ * are used together with the AVX2 micro-kernel only.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <complex.h>
+#include <immintrin.h>
+#include <pthread.h>
+#include "mm_kernel.h"
+
+typedef void (*microkernel)(int, const packed *, const packed *, scalar *, int,
+	scalar, scalar);
+
+static microkernel kernel;
+static char *kernelname;
+#ifdef MM_COMPLEX
+static int gauss;		/* complex leaves use 3M instead of 4M */
+#endif
+/* the first leaf of any thread chooses the kernel, the others wait for it */
+static pthread_once_t kernelonce = PTHREAD_ONCE_INIT;
+
+/* packing buffers, private to each thread and grown on demand */
+static __thread packed *abuf, *bbuf;
+static __thread size_t abufsize, bbufsize;
+
+/*
+ * c (MR by NR, leading dimension ldc) = alpha * a panel * b panel + beta * c.
+ * k is a multiple of KU.  c is not read when beta is zero, so it may
+ * hold garbage.
+ */
+static void scalarkernel(int k, const packed *a, const packed *b,
+		scalar *c, int ldc, scalar alpha, scalar beta)
+{
+	scalar sum[MR][NR] = {{0}};
+	int p, i, j, u;
+
+	for (p = 0; p < k; p += KU, a += MR * KU, b += NR * KU)
+		for (i = 0; i < MR; i++)
+			for (j = 0; j < NR; j++)
+				for (u = 0; u < KU; u++)
+					sum[i][j] += (scalar)a[i * KU + u] * b[j * KU + u];
+
+	for (i = 0; i < MR; i++, c += ldc)
+		for (j = 0; j < NR; j++)
+			c[j] = beta != 0 ? alpha * sum[i][j] + beta * c[j]
+				: alpha * sum[i][j];
+}
+
+#if defined(MM_INT8)
+
+#define FMAROW(r) \
+	memcpy(&pair, a + 2 * r, sizeof(pair)); \
+	ar = _mm256_set1_epi32(pair); \
+	c##r##0 = _mm256_add_epi32(c##r##0, _mm256_madd_epi16(ar, b0)); \
+	c##r##1 = _mm256_add_epi32(c##r##1, _mm256_madd_epi16(ar, b1))
+
+#define STOREROW(r) \
+	c##r##0 = _mm256_mullo_epi32(c##r##0, al); \
+	c##r##1 = _mm256_mullo_epi32(c##r##1, al); \
+	if (beta != 0) { \
+		c##r##0 = _mm256_add_epi32(c##r##0, _mm256_mullo_epi32(be, \
+			_mm256_loadu_si256((__m256i *)(c + r * ldc)))); \
+		c##r##1 = _mm256_add_epi32(c##r##1, _mm256_mullo_epi32(be, \
+			_mm256_loadu_si256((__m256i *)(c + r * ldc + 8)))); \
+	} \
+	_mm256_storeu_si256((__m256i *)(c + r * ldc), c##r##0); \
+	_mm256_storeu_si256((__m256i *)(c + r * ldc + 8), c##r##1)
+
+/* same as scalarkernel, for MR = 6, NR = 16 and KU = 2 */
+__attribute__((target("avx2")))
+static void avx2kernel(int k, const packed *a, const packed *b,
+		scalar *c, int ldc, scalar alpha, scalar beta)
+{
+	__m256i c00 = _mm256_setzero_si256(), c01 = _mm256_setzero_si256();
+	__m256i c10 = _mm256_setzero_si256(), c11 = _mm256_setzero_si256();
+	__m256i c20 = _mm256_setzero_si256(), c21 = _mm256_setzero_si256();
+	__m256i c30 = _mm256_setzero_si256(), c31 = _mm256_setzero_si256();
+	__m256i c40 = _mm256_setzero_si256(), c41 = _mm256_setzero_si256();
+	__m256i c50 = _mm256_setzero_si256(), c51 = _mm256_setzero_si256();
+	__m256i ar, b0, b1, al, be;
+	int p, pair;
+
+	for (p = 0; p < k; p += KU, a += MR * KU, b += NR * KU) {
+		b0 = _mm256_load_si256((const __m256i *)b);
+		b1 = _mm256_load_si256((const __m256i *)(b + 16));
+		FMAROW(0);
+		FMAROW(1);
+		FMAROW(2);
+		FMAROW(3);
+		FMAROW(4);
+		FMAROW(5);
+	}
+
+	al = _mm256_set1_epi32(alpha);
+	be = _mm256_set1_epi32(beta);
+	STOREROW(0);
+	STOREROW(1);
+	STOREROW(2);
+	STOREROW(3);
+	STOREROW(4);
+	STOREROW(5);
+}
+
+#elif defined(MM_FLOAT)
+
+#define FMAROW(r) \
+	ar = _mm256_broadcast_ss(a + r); \
+	c##r##0 = _mm256_fmadd_ps(ar, b0, c##r##0); \
+	c##r##1 = _mm256_fmadd_ps(ar, b1, c##r##1)
+
+#define STOREROW(r) \
+	c##r##0 = _mm256_mul_ps(c##r##0, al); \
+	c##r##1 = _mm256_mul_ps(c##r##1, al); \
+	if (beta != 0) { \
+		c##r##0 = _mm256_fmadd_ps(be, _mm256_loadu_ps(c + r * ldc), c##r##0); \
+		c##r##1 = _mm256_fmadd_ps(be, _mm256_loadu_ps(c + r * ldc + 8), c##r##1); \
+	} \
+	_mm256_storeu_ps(c + r * ldc, c##r##0); \
+	_mm256_storeu_ps(c + r * ldc + 8, c##r##1)
+
+/* same as scalarkernel, for MR = 6 and NR = 16 */
+__attribute__((target("avx2,fma")))
+static void avx2kernel(int k, const packed *a, const packed *b,
+		scalar *c, int ldc, scalar alpha, scalar beta)
+{
+	__m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+	__m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+	__m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+	__m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+	__m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+	__m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+	__m256 ar, b0, b1, al, be;
+	int p;
+
+	for (p = 0; p < k; p++, a += MR, b += NR) {
+		b0 = _mm256_load_ps(b);
+		b1 = _mm256_load_ps(b + 8);
+		FMAROW(0);
+		FMAROW(1);
+		FMAROW(2);
+		FMAROW(3);
+		FMAROW(4);
+		FMAROW(5);
+	}
+
+	al = _mm256_set1_ps(alpha);
+	be = _mm256_set1_ps(beta);
+	STOREROW(0);
+	STOREROW(1);
+	STOREROW(2);
+	STOREROW(3);
+	STOREROW(4);
+	STOREROW(5);
+}
+
+#else
+
+#define FMAROW(r) \
+	ar = _mm256_broadcast_sd(a + r); \
+	c##r##0 = _mm256_fmadd_pd(ar, b0, c##r##0); \
+	c##r##1 = _mm256_fmadd_pd(ar, b1, c##r##1)
+
+#define STOREROW(r) \
+	c##r##0 = _mm256_mul_pd(c##r##0, al); \
+	c##r##1 = _mm256_mul_pd(c##r##1, al); \
+	if (beta != 0) { \
+		c##r##0 = _mm256_fmadd_pd(be, _mm256_loadu_pd(c + r * ldc), c##r##0); \
+		c##r##1 = _mm256_fmadd_pd(be, _mm256_loadu_pd(c + r * ldc + 4), c##r##1); \
+	} \
+	_mm256_storeu_pd(c + r * ldc, c##r##0); \
+	_mm256_storeu_pd(c + r * ldc + 4, c##r##1)
+
+/* same as scalarkernel, for MR = 6 and NR = 8 */
+__attribute__((target("avx2,fma")))
+static void avx2kernel(int k, const packed *a, const packed *b,
+		scalar *c, int ldc, scalar alpha, scalar beta)
+{
+	__m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+	__m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+	__m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+	__m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+	__m256d c40 = _mm256_setzero_pd(), c41 = _mm256_setzero_pd();
+	__m256d c50 = _mm256_setzero_pd(), c51 = _mm256_setzero_pd();
+	__m256d ar, b0, b1, al, be;
+	int p;
+
+	for (p = 0; p < k; p++, a += MR, b += NR) {
+		b0 = _mm256_load_pd(b);
+		b1 = _mm256_load_pd(b + 4);
+		FMAROW(0);
+		FMAROW(1);
+		FMAROW(2);
+		FMAROW(3);
+		FMAROW(4);
+		FMAROW(5);
+	}
+
+	al = _mm256_set1_pd(alpha);
+	be = _mm256_set1_pd(beta);
+	STOREROW(0);
+	STOREROW(1);
+	STOREROW(2);
+	STOREROW(3);
+	STOREROW(4);
+	STOREROW(5);
+}
+
+#endif
+
+/* choose the micro-kernel for this CPU */
+static void kernelinit(void)
+{
+	char *env = getenv("MM_KERNEL");
+
+	__builtin_cpu_init();
+	if ((env == NULL || strcmp(env, "scalar"))
+			&& __builtin_cpu_supports("avx2")
+			&& __builtin_cpu_supports("fma")) {
+		kernelname = "avx2";
+		kernel = avx2kernel;
+	}
+	else {
+		kernelname = "scalar";
+		kernel = scalarkernel;
+	}
+#ifdef MM_COMPLEX
+	env = getenv("MM_CMULT");
+	gauss = env == NULL || strcmp(env, "4m");
+	kernelname = gauss ? (kernel == avx2kernel ? "avx2-3m" : "scalar-3m")
+		: (kernel == avx2kernel ? "avx2-4m" : "scalar-4m");
+#endif
+}
+
+#ifdef MM_COMPLEX
+/*
+ * c (MR by NR, leading dimension ldc) = alpha * a panel * b panel + beta * c
+ * for complex panels, by three or four real micro-kernel products.
+ */
+static void complexkernel(int k, const packed *a, const packed *b,
+		acc *c, int ldc, acc alpha, acc beta)
+{
+	scalar re[MR * NR] __attribute__((aligned(MM_ALIGN)));
+	scalar im[MR * NR] __attribute__((aligned(MM_ALIGN)));
+	scalar t[MR * NR] __attribute__((aligned(MM_ALIGN)));
+	const packed *ar = a, *ai = a + MR * k, *as = a + 2 * MR * k;
+	const packed *br = b, *bi = b + NR * k, *bs = b + 2 * NR * k;
+	int i, j;
+
+	if (gauss) {
+		kernel(k, ar, br, re, NR, 1, 0);
+		kernel(k, ai, bi, t, NR, 1, 0);
+		kernel(k, as, bs, im, NR, 1, 0);
+		for (i = 0; i < MR * NR; i++) {
+			im[i] -= re[i] + t[i];
+			re[i] -= t[i];
+		}
+	}
+	else {
+		kernel(k, ar, br, re, NR, 1, 0);
+		kernel(k, ai, bi, re, NR, -1, 1);
+		kernel(k, ar, bi, im, NR, 1, 0);
+		kernel(k, ai, br, im, NR, 1, 1);
+	}
+
+	for (i = 0; i < MR; i++, c += ldc)
+		for (j = 0; j < NR; j++) {
+			acc z = re[i * NR + j] + im[i * NR + j] * I;
+			c[j] = beta != 0 ? alpha * z + beta * c[j] : alpha * z;
+		}
+}
+
+#define BLOCKKERNEL complexkernel
+#else
+#define BLOCKKERNEL kernel
+#endif
+
+char *LeafKernel(void)
+{
+	pthread_once(&kernelonce, kernelinit);
+	return kernelname;
+}
+
+/* make sure *buf holds at least size packed elements */
+static packed *reserve(packed **buf, size_t *bufsize, size_t size)
+{
+	void *p = NULL;
+
+	if (size > *bufsize) {
+		free(*buf);
+		check(posix_memalign(&p, MM_ALIGN, size * sizeof(packed)) == 0,
+			"reserve: out of space for packing buffer");
+		*buf = p;
+		*bufsize = size;
+	}
+	return *buf;
+}
+
+#ifdef MM_COMPLEX
+/* part of the complex element x that goes into planar panel part */
+static inline scalar planar(elem x, int part, int trans)
+{
+	scalar im = trans == CONJTRANS ? -cimag(x) : cimag(x);
+
+	return part == 0 ? creal(x) : part == 1 ? im : creal(x) + im;
+}
+#else
+#define planar(x, part, trans) (x)
+#endif
+
+/*
+ * Copy the m by k matrix op(a) into zero padded panels of MR rows,
+ * where op(a) is a, or the transpose of the k by m matrix a if trans
+ * is set, conjugated as well if trans is CONJTRANS.  Transposing costs
+ * nothing extra here, as every element is copied anyway.  k is padded
+ * to a multiple of KU, and complex panels are split into PARTS planes.
+ */
+void PackA(matrix a, int trans, packed *p)
+{
+	int i, ir, l, u, part, m = trans ? a.cols : a.rows, k = trans ? a.rows : a.cols;
+
+	for (ir = 0; ir < m; ir += MR)
+		for (part = 0; part < PARTS; part++)
+			for (l = 0; l < k; l += KU)
+				for (i = ir; i < ir + MR; i++)
+					for (u = l; u < l + KU; u++)
+						*p++ = i >= m || u >= k ? 0 : planar(trans
+							? ELEM(a, u, i) : ELEM(a, i, u), part, trans);
+}
+
+/* copy the k by n matrix op(b) into zero padded panels of NR columns */
+void PackB(matrix b, int trans, packed *p)
+{
+	int j, jr, l, u, part, k = trans ? b.cols : b.rows, n = trans ? b.rows : b.cols;
+
+	for (jr = 0; jr < n; jr += NR)
+		for (part = 0; part < PARTS; part++)
+			for (l = 0; l < k; l += KU)
+				for (j = jr; j < jr + NR; j++)
+					for (u = l; u < l + KU; u++)
+						*p++ = j >= n || u >= k ? 0 : planar(trans
+							? ELEM(b, j, u) : ELEM(b, u, j), part, trans);
+}
+
+/*
+ * c = alpha*a*b + beta*c, where a and b are already packed by PackA and
+ * PackB and k is their common dimension.  The b micro-panel stays in
+ * L1 while all the a micro-panels stream past it.
+ */
+void MacroKernel(int k, const packed *pa, const packed *pb, accmatrix c,
+	acc alpha, acc beta)
+{
+	int m = c.rows, n = c.cols;
+	int i, j, ir, jr, mr, nr;
+	acc edge[MR * NR] __attribute__((aligned(MM_ALIGN)));
+
+	pthread_once(&kernelonce, kernelinit);
+
+	for (jr = 0; jr < n; jr += NR) {
+		nr = n - jr < NR ? n - jr : NR;
+		for (ir = 0; ir < m; ir += MR) {
+			const packed *a = pa + (size_t)ir * PACKLEN(k);
+			const packed *b = pb + (size_t)jr * PACKLEN(k);
+
+			mr = m - ir < MR ? m - ir : MR;
+			if (mr == MR && nr == NR) {
+				BLOCKKERNEL(KPAD(k), a, b, &ELEM(c, ir, jr), c.ld,
+					alpha, beta);
+				continue;
+			}
+			BLOCKKERNEL(KPAD(k), a, b, edge, NR, alpha, 0);
+			for (i = 0; i < mr; i++) {
+				acc *r = &ELEM(c, ir + i, jr);
+				for (j = 0; j < nr; j++)
+					r[j] = beta != 0 ? edge[i * NR + j] + beta * r[j]
+						: edge[i * NR + j];
+			}
+		}
+	}
+}
+
+/*
+ * c = alpha*op(a)*op(b) + beta*c, where op(x) is x or its transpose
+ * as transa and transb say.  The scaling happens in the micro-kernel
+ * as c is stored, so it costs no extra pass over c.
+ */
+void LeafGemm(int transa, int transb, acc alpha, matrix a, matrix b,
+	acc beta, accmatrix c)
+{
+	int m = c.rows, n = c.cols, k = transa ? a.rows : a.cols;
+
+	reserve(&abuf, &abufsize, (size_t)(m + MR - 1) / MR * MR * PACKLEN(k));
+	reserve(&bbuf, &bbufsize, (size_t)(n + NR - 1) / NR * NR * PACKLEN(k));
+	PackA(a, transa, abuf);
+	PackB(b, transb, bbuf);
+	MacroKernel(k, abuf, bbuf, c, alpha, beta);
+}
+
+/* kernel of fixed size for c = a*b or c = c + a*b, or NULL if none */
+static leafmult fixedleaf(matrix a, accmatrix c, int add)
+{
+	pthread_once(&kernelonce, kernelinit);
+	return kernel == avx2kernel ? FixedMult(c.rows, a.cols, c.cols, add) : NULL;
+}
+
+/* c = a*b */
+void LeafMult(matrix a, matrix b, accmatrix c)
+{
+	leafmult fixed = fixedleaf(a, c, 0);
+
+	if (fixed != NULL)
+		fixed(a, b, c);
+	else
+		LeafGemm(NOTRANS, NOTRANS, 1, a, b, 0, c);
+}
+
+/* c = c + a*b */
+void LeafMultAdd(matrix a, matrix b, accmatrix c)
+{
+	leafmult fixed = fixedleaf(a, c, 1);
+
+	if (fixed != NULL)
+		fixed(a, b, c);
+	else
+		LeafGemm(NOTRANS, NOTRANS, 1, a, b, 1, c);
+}
+
+/*
+ * Dynamic peeling for odd sizes.  Split the m by k matrix a and the k
+ * by n matrix b as
+ *
+ *	a = | a11 a12 |		b = | b11 b12 |
+ *	    | a21 a22 |		    | b21 b22 |
+ *
+ * where a11 and b11 are the leading blocks of even size PEEL(a) and
+ * PEEL(b), and the other blocks are empty or a single row or column.
+ * Once the caller has set PEEL(c) to a11*b11, complete c = a*b with
+ *
+ *	c11 = c11 + a12*b21	a rank-one update, if k is odd
+ *	c12 = a1 * b12		the last column, if n is odd
+ *	c21 = a21 * b		the last row, if m is odd
+ *
+ * where a1 is the top m-1 or m rows of a.  This costs O(mn + mk + kn)
+ * and lets the recursive algorithms keep halving the even part.
+ */
+void PeelMult(matrix a, matrix b, accmatrix c)
+{
+	int m = c.rows & ~1, k = a.cols & ~1, n = c.cols & ~1;
+
+	if (k < a.cols)
+		LeafMultAdd(submatrix(a, 0, k, m, 1), submatrix(b, k, 0, 1, n),
+			accsubmatrix(c, 0, 0, m, n));
+	if (n < c.cols)
+		LeafMult(submatrix(a, 0, 0, m, a.cols), submatrix(b, 0, n, b.rows, 1),
+			accsubmatrix(c, 0, n, m, 1));
+	if (m < c.rows)
+		LeafMult(submatrix(a, m, 0, 1, a.cols), b, accsubmatrix(c, m, 0, 1, c.cols));
+}
@@ -0,0 +1,85 @@
+/*
+ * mm_kernel.h
+ *
+ * Header file for the leaf kernel shared by the tiled, recursive and
+ * Strassen engines.
+ */
+
+#ifndef MM_KERNEL_H
+#define MM_KERNEL_H
+
+#include "mm_matrix.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Register block of the micro-kernels: MR rows by NR columns of the
+ * result are held in registers while the k loop runs.  Panels hold
+ * packed elements and group KU consecutive values of k, which the
+ * micro-kernel consumes in one step; KPAD() rounds k up to a multiple.
+ */
+#if defined(MM_INT8)
+#define MR 6
+#define NR 16
+#define KU 2
+typedef short packed;
+#elif defined(MM_FLOAT)
+#define MR 6
+#define NR 16
+#define KU 1
+typedef float packed;
+#else
+#define MR 6
+#define NR 8
+#define KU 1
+typedef double packed;
+#endif
+
+#define KPAD(k) (((k) + KU - 1) / KU * KU)
+
+/*
+ * Complex panels are stored as PARTS real panels one after the other:
+ * the real parts, the imaginary parts and their sums, the last needed
+ * by the 3M algorithm only.  PACKLEN(k) is the number of packed
+ * elements per row of an a panel, or per column of a b panel.
+ */
+#ifdef MM_COMPLEX
+#define PARTS 3
+#else
+#define PARTS 1
+#endif
+
+#define PACKLEN(k) (PARTS * KPAD(k))
+
+/* trans argument of the packing routines: op(x) is x, x' or conj(x') */
+#define NOTRANS 0
+#define TRANS 1
+#define CONJTRANS 2
+
+/* leading block of even size of a matrix, see PeelMult() */
+#define PEEL(a) submatrix(a, 0, 0, (a).rows & ~1, (a).cols & ~1)
+
+void LeafMult(matrix, matrix, accmatrix);	/* c = a*b */
+void LeafMultAdd(matrix, matrix, accmatrix);	/* c = c + a*b */
+void LeafGemm(int, int, acc, matrix, matrix, acc, accmatrix);
+					/* c = alpha*op(a)*op(b) + beta*c */
+char *LeafKernel(void);				/* name of the micro-kernel in use */
+void PeelMult(matrix, matrix, accmatrix);	/* finish c = a*b after the */
+						/* product of the even parts */
+
+/* leaves of a fixed size, unrolled at compile time, mm_fixed.cpp */
+typedef void (*leafmult)(matrix, matrix, accmatrix);
+leafmult FixedMult(int, int, int, int);	/* kernel for m, k, n, add or NULL */
+
+/* building blocks of the leaf kernel, also used by the packed engine */
+void PackA(matrix, int, packed *);	/* op(a) into zero padded MR-row panels */
+void PackB(matrix, int, packed *);	/* op(b) into zero padded NR-column panels */
+void MacroKernel(int, const packed *, const packed *, accmatrix, acc, acc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MM_KERNEL_H */
@@ -0,0 +1,295 @@
+/*
+ * mm_matrix.c
+ *
+ * Allocation, initialization and output routines of the matrix core.
+ *
+ * Every matrix lives in a single buffer aligned to MM_ALIGN bytes.
+ * The leading dimension is rounded up so that every row starts on an
+ * MM_ALIGN boundary as well, which keeps vector loads of row
+ * segments aligned no matter which tile or quadrant they belong to.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <complex.h>
+#include "mm_matrix.h"
+
+/* leading dimension of a matrix with cols columns of size bytes each */
+static int leading(int cols, size_t size)
+{
+	int step = MM_ALIGN / size;
+
+	return (cols + step - 1) / step * step;
+}
+
+/* number of elements occupied by a rows by cols matrix */
+size_t matrixspace(int rows, int cols)
+{
+	return (size_t)rows * leading(cols, sizeof(elem));
+}
+
+/* return zeroed, aligned storage for rows rows of ld elements of size bytes */
+static void *newstorage(int rows, int ld, size_t size)
+{
+	void *buf;
+
+	size *= (size_t)rows * ld;
+	check(posix_memalign(&buf, MM_ALIGN, size) == 0,
+		"newmatrix: out of space for matrix");
+	memset(buf, 0, size);
+	return buf;
+}
+
+/* return new zeroed rows by cols matrix */
+matrix newmatrix(int rows, int cols)
+{
+	matrix a;
+
+	check(rows > 0 && cols > 0, "newmatrix: invalid matrix dimensions");
+	a.rows = rows;
+	a.cols = cols;
+	a.ld = leading(cols, sizeof(elem));
+	a.d = newstorage(rows, a.ld, sizeof(elem));
+	return a;
+}
+
+/* free storage of matrix a */
+void freematrix(matrix a)
+{
+	free(a.d);
+}
+
+/* return new arena of size elements */
+arena newarena(size_t size)
+{
+	arena w;
+	void *buf = NULL;
+
+	if (size > 0)
+		check(posix_memalign(&buf, MM_ALIGN, size * sizeof(elem)) == 0,
+			"newarena: out of space for scratch arena");
+	w.base = buf;
+	w.size = size;
+	w.top = 0;
+	return w;
+}
+
+void freearena(arena w)
+{
+	free(w.base);
+}
+
+/*
+ * Return an uninitialized rows by cols matrix from the top of arena w.
+ * Since every matrixspace() is a whole number of MM_ALIGN blocks, all
+ * scratch matrices stay aligned.
+ */
+matrix scratchmatrix(arena *w, int rows, int cols)
+{
+	matrix a;
+	size_t size = matrixspace(rows, cols);
+
+	check(w->top + size <= w->size, "scratchmatrix: scratch arena exhausted");
+	a.d = w->base + w->top;
+	a.rows = rows;
+	a.cols = cols;
+	a.ld = leading(cols, sizeof(elem));
+	w->top += size;
+	return a;
+}
+
+/* return an arena of size elements taken from the top of arena w */
+arena subarena(arena *w, size_t size)
+{
+	arena s;
+
+	check(w->top + size <= w->size, "subarena: scratch arena exhausted");
+	s.base = w->base + w->top;
+	s.size = size;
+	s.top = 0;
+	w->top += size;
+	return s;
+}
+
+/*
+ * Philox4x32-10, the counter-based generator of Salmon et al.,
+ * ``Parallel random numbers: as easy as 1, 2, 3'' (SC 2011): ten
+ * rounds of a bijection of the 128-bit counter c under the 64-bit key
+ * k0:k1, which leave c as 128 random bits.
+ */
+static inline void philox(uint32_t c[4], uint32_t k0, uint32_t k1)
+{
+	uint64_t p0, p1;
+	int r;
+
+	for (r = 0; r < 10; r++) {
+		p0 = (uint64_t)0xd2511f53 * c[0];
+		p1 = (uint64_t)0xcd9e8d57 * c[2];
+		c[0] = (uint32_t)(p1 >> 32) ^ c[1] ^ k0;
+		c[1] = (uint32_t)p1;
+		c[2] = (uint32_t)(p0 >> 32) ^ c[3] ^ k1;
+		c[3] = (uint32_t)p0;
+		k0 += 0x9e3779b9;
+		k1 += 0xbb67ae85;
+	}
+}
+
+#ifndef MM_INT8
+/* uniform value in [0,1) of the random bits hi:lo, as precise as scalar */
+static inline scalar unit(uint32_t hi, uint32_t lo)
+{
+#ifdef MM_FLOAT
+	(void)lo;
+	return (hi >> 8) * 0x1p-24f;
+#else
+	return ((uint64_t)hi << 21 | lo >> 11) * 0x1p-53;
+#endif
+}
+#endif
+
+/* random element (i,j) of the matrix of the given seed */
+static inline elem randomelem(unsigned seed, uint32_t i, uint32_t j)
+{
+	uint32_t c[4] = { i, j, 0, 0 };
+
+	philox(c, seed, 0);
+#if defined(MM_INT8)
+	return (signed char)(c[0] >> 24);
+#elif defined(MM_COMPLEX)
+	return unit(c[0], c[1]) + unit(c[2], c[3]) * I;
+#else
+	return unit(c[0], c[1]);
+#endif
+}
+
+/*
+ * Fill the matrix a with random values between 0 and 1, or over the
+ * whole range of int8 for integer matrices.  Complex elements get
+ * random real and imaginary parts.  Element (i,j) is a function of
+ * seed, i and j alone, so the rows are filled in parallel and a
+ * matrix comes out the same however it is traversed or split.
+ */
+void randomfill(matrix a, unsigned seed)
+{
+	randomblock(a, seed, 0, 0);
+}
+
+/*
+ * Fill a as the block at row i0, column j0 of the random matrix of
+ * the given seed, so that the tiles of a matrix, or the matrices of a
+ * batch, can be filled one by one with the values of the whole.
+ */
+void randomblock(matrix a, unsigned seed, long i0, long j0)
+{
+	long i;
+
+	#pragma omp parallel for schedule(static)
+	for (i = 0; i < a.rows; i++) {
+		elem *p = ROW(a, i);
+		int j;
+
+		for (j = 0; j < a.cols; j++)
+			p[j] = randomelem(seed, i0 + i, j0 + j);
+	}
+}
+
+/* set all elements of a to zero */
+void zeromatrix(matrix a)
+{
+	int i;
+
+	for (i = 0; i < a.rows; i++)
+		memset(ROW(a, i), 0, a.cols * sizeof(elem));
+}
+
+/* print matrix a into file f */
+void print(matrix a, FILE *f)
+{
+	int i, j;
+
+	for (i = 0; i < a.rows; i++) {
+		elem *p = ROW(a, i);
+		for (j = 0; j < a.cols; j++)
+#ifdef MM_COMPLEX
+			fprintf(f, "%lf%+lfi ", creal(p[j]), cimag(p[j]));
+#else
+			fprintf(f, ELEMFMT, p[j]);
+#endif
+		fprintf(f, "\n");
+	}
+}
+
+#ifdef MM_INT8
+/* return new zeroed rows by cols result matrix */
+accmatrix newaccmatrix(int rows, int cols)
+{
+	accmatrix a;
+
+	check(rows > 0 && cols > 0, "newaccmatrix: invalid matrix dimensions");
+	a.rows = rows;
+	a.cols = cols;
+	a.ld = leading(cols, sizeof(acc));
+	a.d = newstorage(rows, a.ld, sizeof(acc));
+	return a;
+}
+
+void freeaccmatrix(accmatrix a)
+{
+	free(a.d);
+}
+
+void zeroaccmatrix(accmatrix a)
+{
+	int i;
+
+	for (i = 0; i < a.rows; i++)
+		memset(ROW(a, i), 0, a.cols * sizeof(acc));
+}
+
+void printacc(accmatrix a, FILE *f)
+{
+	int i, j;
+
+	for (i = 0; i < a.rows; i++) {
+		acc *p = ROW(a, i);
+		for (j = 0; j < a.cols; j++)
+			fprintf(f, ACCFMT, p[j]);
+		fprintf(f, "\n");
+	}
+}
+#endif
+
+/*
+ * Parse the dimensions of the product of an m by k and a k by n matrix
+ * from s, which is either a single size n for square matrices or the
+ * three sizes written as MxKxN.
+ */
+void parsesize(char *s, int *m, int *k, int *n)
+{
+	if (sscanf(s, "%dx%dx%d", m, k, n) != 3)
+		*m = *k = *n = atoi(s);
+	check(*m > 0 && *k > 0 && *n > 0, "parsesize: invalid matrix size");
+}
+
+/* write the size of an m by k times k by n product into s */
+void sizename(char *s, int m, int k, int n)
+{
+	if (m == k && k == n)
+		sprintf(s, "%d", n);
+	else
+		sprintf(s, "%dx%dx%d", m, k, n);
+}
+
+/*
+ * If the expression e is false print the error message s and quit.
+ */
+
+void check(int e, char *s)
+{
+	if (!e) {
+		fprintf(stderr, "Fatal error -> %s\n", s);
+		exit(1);
+	}
+}
@@ -0,0 +1,193 @@
+/*
+ * mm_matrix.h
+ *
+ * Header file for the matrix core shared by all multiplication programs.
+ */
+
+#ifndef MM_MATRIX_H
+#define MM_MATRIX_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Element type, fixed at compile time: double by default, float with
+ * -DMM_FLOAT, and with -DMM_INT8 8-bit integer inputs whose products are
+ * accumulated into 32-bit integer results.  -DMM_COMPLEX makes double
+ * or float complex.  elem is the type of the operands a and b, acc
+ * that of the result c and of the accumulators, and scalar the real
+ * type the micro-kernels compute in.  ELEMSUFFIX tells the programs
+ * built for each type, and their output files, apart, and
+ * ELEMFMT/ACCFMT print real elements.
+ */
+
+#if defined(MM_COMPLEX) && defined(MM_INT8)
+#error "MM_COMPLEX and MM_INT8 do not combine"
+#elif defined(MM_COMPLEX) && defined(MM_FLOAT)
+typedef float _Complex elem;
+typedef elem acc;
+typedef float scalar;
+#define ELEMSUFFIX "_c"
+#elif defined(MM_COMPLEX)
+typedef double _Complex elem;
+typedef elem acc;
+typedef double scalar;
+#define ELEMSUFFIX "_z"
+#elif defined(MM_INT8)
+typedef signed char elem;
+typedef int acc;
+typedef int scalar;
+#define ELEMSUFFIX "_i8"
+#define ELEMFMT "%d "
+#define ACCFMT "%d "
+#elif defined(MM_FLOAT)
+typedef float elem;
+typedef float acc;
+typedef float scalar;
+#define ELEMSUFFIX "_f"
+#define ELEMFMT "%f "
+#define ACCFMT "%f "
+#else
+typedef double elem;
+typedef double acc;
+typedef double scalar;
+#define ELEMSUFFIX ""
+#define ELEMFMT "%lf "
+#define ACCFMT "%lf "
+#endif
+
+/*
+ * A matrix is a small descriptor (a ``view'') of a rows by cols block
+ * of elements stored row after row in one contiguous, aligned buffer.
+ * Element (i,j) lives at d[i*ld+j], where the leading dimension ld is
+ * the distance between the starts of two consecutive rows.  Tiles and
+ * quadrants are views sharing the storage of their parent, so that
+ * splitting a matrix never allocates and every row is a contiguous,
+ * cache-friendly run of memory.
+ */
+
+typedef struct _matrix {
+	elem *d;		/* element (0,0) */
+	int rows, cols;		/* dimensions */
+	int ld;			/* leading dimension */
+} matrix;
+
+/*
+ * An arena is scratch space preallocated in one piece and handed out
+ * with a bump pointer.  Scratch matrices are released in LIFO order by
+ * resetting top to a value saved before they were allocated, so a
+ * recursive algorithm reuses the same slice of the arena for every call
+ * at a given depth and never touches the allocator on its hot path.
+ */
+
+typedef struct _arena {
+	elem *base;		/* start of the scratch space */
+	size_t size;		/* capacity in elements */
+	size_t top;		/* first free element */
+} arena;
+
+/*
+ * Results are held in an accmatrix, which is just a matrix unless the
+ * accumulator type differs from the element type.
+ */
+
+#ifdef MM_INT8
+typedef struct _accmatrix {
+	acc *d;
+	int rows, cols;
+	int ld;
+} accmatrix;
+#else
+typedef matrix accmatrix;
+#endif
+
+#define MM_ALIGN 64		/* alignment of buffers and rows in bytes */
+
+/* seeds of the random operands a and b of the programs */
+#define SEEDA 1
+#define SEEDB 2
+
+/* element (i,j) of matrix a */
+#define ELEM(a, i, j) ((a).d[(size_t)(i) * (a).ld + (j)])
+
+/* pointer to row i of matrix a */
+#define ROW(a, i) ((a).d + (size_t)(i) * (a).ld)
+
+matrix newmatrix(int, int);	/* allocate zeroed rows by cols matrix */
+void freematrix(matrix);	/* free storage of a matrix from newmatrix */
+void randomfill(matrix, unsigned);	/* fill with random values of seed in [0,1) */
+void randomblock(matrix, unsigned, long, long);	/* block (i,j) of the same */
+void zeromatrix(matrix);	/* set all elements to zero */
+void print(matrix, FILE *);	/* print matrix in file */
+void check(int, char *);	/* check for error conditions */
+void parsesize(char *, int *, int *, int *);	/* "n" or "MxKxN" */
+void sizename(char *, int, int, int);	/* inverse of parsesize */
+
+size_t matrixspace(int, int);	/* elements needed by a rows by cols matrix */
+arena newarena(size_t);		/* preallocate scratch space of n elements */
+void freearena(arena);
+matrix scratchmatrix(arena *, int, int);	/* uninitialized scratch matrix */
+arena subarena(arena *, size_t);	/* carve n elements out of an arena */
+
+#ifdef MM_INT8
+accmatrix newaccmatrix(int, int);	/* same as above for results */
+void freeaccmatrix(accmatrix);
+void zeroaccmatrix(accmatrix);
+void printacc(accmatrix, FILE *);
+#else
+#define newaccmatrix newmatrix
+#define freeaccmatrix freematrix
+#define zeroaccmatrix zeromatrix
+#define printacc print
+#define accsubmatrix submatrix
+#endif
+
+/* TBB scheduler of the task-parallel engines, mm_tasks.cpp */
+void ParInit(int);		/* limit the scheduler to n threads, 0 = all */
+int ParThreads(void);		/* number of threads the scheduler uses */
+
+/* rows by cols submatrix of a starting at element (i,j) */
+static inline matrix submatrix(matrix a, int i, int j, int rows, int cols)
+{
+	matrix s;
+
+	s.d = a.d + (size_t)i * a.ld + j;
+	s.rows = rows;
+	s.cols = cols;
+	s.ld = a.ld;
+	return s;
+}
+
+#ifdef MM_INT8
+static inline accmatrix accsubmatrix(accmatrix a, int i, int j, int rows, int cols)
+{
+	accmatrix s;
+
+	s.d = a.d + (size_t)i * a.ld + j;
+	s.rows = rows;
+	s.cols = cols;
+	s.ld = a.ld;
+	return s;
+}
+#endif
+
+/*
+ * Quadrant q of a, numbered 0 1 / 2 3 in row-major order.  Matrices
+ * split this way are expected to have even dimensions.
+ */
+static inline matrix quadrant(matrix a, int q)
+{
+	int h = a.rows / 2, w = a.cols / 2;
+
+	return submatrix(a, (q >> 1) * h, (q & 1) * w, h, w);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MM_MATRIX_H */
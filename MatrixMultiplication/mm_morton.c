@@ -0,0 +1,129 @@
+/*
+ * mm_morton.c
+ *
+ * Morton order storage and its conversion from and to row-major
+ * matrices.  Tile t of the Morton order of a square grid is tile
+ * (row, col) of the grid where the bits of t alternate between those
+ * of row and col,
+ *
+ *	t = ... r1 c1 r0 c0
+ *
+ * so that every pair of bits selects one quadrant, from the largest
+ * down.  In a taller or wider grid the bits of t above those pairs are
+ * the high bits of row or col, each selecting one half.  The
+ * conversions copy whole tile rows with memcpy and are spread over the
+ * OpenMP threads tile by tile.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "mm_morton.h"
+
+/* the even bits of t, packed together */
+static int evenbits(size_t t)
+{
+	int x = 0, i;
+
+	for (i = 0; t != 0; i++, t >>= 2)
+		x |= (int)(t & 1) << i;
+	return x;
+}
+
+/* n clamped to 0 .. max */
+static int clamp(int n, int max)
+{
+	return n < 0 ? 0 : n > max ? max : n;
+}
+
+/* return new zeroed zmatrix for rows by cols elements in tiles of tile */
+zmatrix newzmatrix(int rows, int cols, int tile)
+{
+	zmatrix z;
+	void *buf = NULL;
+
+	check(rows > 0 && cols > 0 && tile > 0, "newzmatrix: invalid matrix dimensions");
+	z.rows = rows;
+	z.cols = cols;
+	z.tile = tile;
+	z.rlevels = mortonlevels(rows, tile);
+	z.clevels = mortonlevels(cols, tile);
+	check(posix_memalign(&buf, MM_ALIGN, ZSIZE(z, z.rlevels, z.clevels) * sizeof(elem)) == 0,
+		"newzmatrix: out of space for matrix");
+	memset(buf, 0, ZSIZE(z, z.rlevels, z.clevels) * sizeof(elem));
+	z.d = buf;
+	return z;
+}
+
+void freezmatrix(zmatrix z)
+{
+	free(z.d);
+}
+
+/* number of levels of a side of tile by tile tiles covering n */
+int mortonlevels(int n, int tile)
+{
+	int levels = 0;
+
+	while ((long)tile << levels < n)
+		levels++;
+	return levels;
+}
+
+/* first row *i0 and column *j0 of tile t of z */
+static void tileorigin(zmatrix z, long t, int *i0, int *j0)
+{
+	int l = z.rlevels < z.clevels ? z.rlevels : z.clevels;
+	long low = t & ((1L << 2 * l) - 1), high = t >> 2 * l;
+	int row = evenbits(low >> 1), col = evenbits(low);
+
+	if (z.rlevels > z.clevels)
+		row |= high << l;
+	else
+		col |= high << l;
+	*i0 = row * z.tile;
+	*j0 = col * z.tile;
+}
+
+/* z = a, zero beyond the dimensions of a */
+void tomorton(matrix a, zmatrix z)
+{
+	long t, ntiles = 1L << (z.rlevels + z.clevels);
+
+	check(a.rows == z.rows && a.cols == z.cols, "tomorton: different dimensions");
+
+	#pragma omp parallel for schedule(static)
+	for (t = 0; t < ntiles; t++) {
+		matrix s = ztile(z, t);
+		int i, i0, j0, rows, cols;
+
+		tileorigin(z, t, &i0, &j0);
+		rows = clamp(a.rows - i0, z.tile);
+		cols = clamp(a.cols - j0, z.tile);
+		for (i = 0; i < rows; i++) {
+			memcpy(ROW(s, i), ROW(a, i0 + i) + j0, cols * sizeof(elem));
+			memset(ROW(s, i) + cols, 0, (z.tile - cols) * sizeof(elem));
+		}
+		for (; i < z.tile; i++)
+			memset(ROW(s, i), 0, z.tile * sizeof(elem));
+	}
+}
+
+/* a = z */
+void frommorton(zmatrix z, matrix a)
+{
+	long t, ntiles = 1L << (z.rlevels + z.clevels);
+
+	check(a.rows == z.rows && a.cols == z.cols, "frommorton: different dimensions");
+
+	#pragma omp parallel for schedule(static)
+	for (t = 0; t < ntiles; t++) {
+		matrix s = ztile(z, t);
+		int i, i0, j0, rows, cols;
+
+		tileorigin(z, t, &i0, &j0);
+		rows = clamp(a.rows - i0, z.tile);
+		cols = clamp(a.cols - j0, z.tile);
+		for (i = 0; i < rows; i++)
+			memcpy(ROW(a, i0 + i) + j0, ROW(s, i), cols * sizeof(elem));
+	}
+}
@@ -0,0 +1,71 @@
+/*
+ * mm_morton.h
+ *
+ * Header file for matrices stored in Morton (Z-curve) order of tiles.
+ */
+
+#ifndef MM_MORTON_H
+#define MM_MORTON_H
+
+#include "mm_matrix.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A zmatrix holds a rows by cols matrix as a 2^rlevels by 2^clevels
+ * grid of tile by tile tiles, each stored row after row, with the
+ * tiles in Morton order: a square grid as its four quadrants one after
+ * the other, 0 1 / 2 3 in row-major order, a grid of more tile rows
+ * than columns as its top half and then its bottom half, and one of
+ * more columns as its left half and then its right half, each part
+ * laid out the same way down to single tiles.  Every part at every
+ * level is thus one contiguous slice.  Each side of the grid is the
+ * smallest power of two of tiles that covers the matrix, padded with
+ * zeros beyond rows and cols.
+ */
+
+typedef struct _zmatrix {
+	elem *d;		/* first tile */
+	int rows, cols;		/* dimensions of the matrix stored */
+	int tile;		/* tiles are tile by tile */
+	int rlevels, clevels;	/* the grid is 2^rlevels by 2^clevels tiles */
+} zmatrix;
+
+zmatrix newzmatrix(int, int, int);	/* rows, cols, tile, zeroed */
+void freezmatrix(zmatrix);
+int mortonlevels(int, int);	/* levels for size n with tiles of tile */
+void tomorton(matrix, zmatrix);	/* copy row-major matrix into Morton order */
+void frommorton(zmatrix, matrix);	/* and back */
+
+/* elements in a part of 2^rl by 2^cl tiles, 0 and 0 being a single tile */
+#define ZSIZE(z, rl, cl) ((size_t)(z).tile * (z).tile << ((rl) + (cl)))
+
+/* tile t, in Morton order, of z as a matrix view */
+static inline matrix ztile(zmatrix z, size_t t)
+{
+	matrix s;
+
+	s.d = z.d + t * ZSIZE(z, 0, 0);
+	s.rows = s.cols = s.ld = z.tile;
+	return s;
+}
+
+/*
+ * Part (ri, ci) of a part of 2^rl by 2^cl tiles split in halves of its
+ * rows if rsplit and of its columns if csplit, as its layout has it:
+ * both for a quadrant, ri or ci only for a half.
+ */
+static inline zmatrix zpart(zmatrix z, int rl, int cl, int rsplit, int csplit,
+	int ri, int ci)
+{
+	z.d += (size_t)(ri * (csplit + 1) + ci) * (ZSIZE(z, rl, cl) >> (rsplit + csplit));
+	return z;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MM_MORTON_H */
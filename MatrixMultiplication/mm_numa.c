@@ -0,0 +1,166 @@
+/*
+ * mm_numa.c
+ *
+ * NUMA placement of matrices.  Linux puts a page on the node of the
+ * thread that touches it first, so a copy of a matrix made by threads
+ * bound to their nodes, each copying the rows it will compute on, lands
+ * where it is used: NumaRows() places a and c of the tiled product that
+ * way, in bands of tile rows.  An operand every thread reads all of,
+ * such as b, is better interleaved page by page over all nodes, which
+ * NumaSpread() does.
+ *
+ * Pages are placed whole, so the copies start on a page, and the rows
+ * of a NumaRows() copy are padded so that every band does as well.
+ *
+ * Built without -DMM_NUMA, as the Makefile does where libnuma is
+ * missing, or run where libnuma finds no NUMA support, the machine
+ * counts as a single node and the copies are plain ones.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <omp.h>
+#ifdef MM_NUMA
+#include <numa.h>
+#endif
+#include "mm_numa.h"
+
+static int nodes;
+
+int NumaNodes(void)
+{
+	if (nodes == 0) {
+		nodes = 1;
+#ifdef MM_NUMA
+		if (numa_available() >= 0)
+			nodes = numa_max_node() + 1;
+#endif
+	}
+	return nodes;
+}
+
+int NumaNode(int t, int nthreads)
+{
+	return (long)t * NumaNodes() / nthreads;
+}
+
+/* first of n items of thread t of nthreads */
+static int share(int t, int nthreads, int n)
+{
+	return (long)t * n / nthreads;
+}
+
+int NumaFirst(int d, int nthreads, int n)
+{
+	int nodes = NumaNodes();
+
+	/* the first thread t with t*nodes/nthreads >= d */
+	return share(((long)d * nthreads + nodes - 1) / nodes, nthreads, n);
+}
+
+void NumaBind(void)
+{
+#ifdef MM_NUMA
+	if (NumaNodes() > 1)
+		numa_run_on_node(NumaNode(omp_get_thread_num(), omp_get_num_threads()));
+#endif
+}
+
+static long gcd(long x, long y)
+{
+	return y == 0 ? x : gcd(y, x % y);
+}
+
+/* uninitialized, page aligned storage of size bytes, no page touched yet */
+static void *rawstorage(size_t size)
+{
+	void *buf = NULL;
+
+	check(posix_memalign(&buf, sysconf(_SC_PAGESIZE), size) == 0,
+		"rawstorage: out of space for matrix");
+	return buf;
+}
+
+/*
+ * Leading dimension of a copy of rows of ld elements of size bytes
+ * placed in items of unit rows: ld rounded up to a multiple of both the
+ * element count of MM_ALIGN bytes and of g, for which an item of unit
+ * rows of g elements is a whole number of pages.
+ */
+static int bandld(int ld, int unit, size_t size)
+{
+	long page = sysconf(_SC_PAGESIZE), g = page / gcd(page, unit * (long)size);
+	long e = MM_ALIGN / size, step = g / gcd(g, e) * e;
+
+	return (ld + step - 1) / step * step;
+}
+
+/*
+ * Copy rows rows of cols elements of size bytes, ld elements apart at
+ * src, to dst, pld apart and zero padded to that, each thread bound to
+ * its node copying the items of unit rows it owns.
+ */
+static void placerows(char *dst, int pld, const char *src, int ld, int rows,
+	int cols, size_t size, int unit)
+{
+	int items = (rows + unit - 1) / unit;
+
+	#pragma omp parallel
+	{
+		int t = omp_get_thread_num(), nthreads = omp_get_num_threads();
+		int i, first = share(t, nthreads, items) * unit, last = share(t + 1, nthreads, items) * unit;
+
+		NumaBind();
+		for (i = first; i < last && i < rows; i++) {
+			memcpy(dst + (size_t)i * pld * size, src + (size_t)i * ld * size, cols * size);
+			memset(dst + ((size_t)i * pld + cols) * size, 0, (size_t)(pld - cols) * size);
+		}
+	}
+}
+
+/*
+ * Copy of a whose rows are placed on the nodes that own them when the
+ * rows are split into items of unit rows.  Its rows are padded so that
+ * every item starts on a page.
+ */
+matrix NumaRows(matrix a, int unit)
+{
+	matrix p = a;
+
+	p.ld = bandld(a.ld, unit, sizeof(elem));
+	p.d = rawstorage((size_t)a.rows * p.ld * sizeof(elem));
+	placerows((char *)p.d, p.ld, (char *)a.d, a.ld, a.rows, a.cols, sizeof(elem), unit);
+	return p;
+}
+
+#ifdef MM_INT8
+accmatrix NumaAccRows(accmatrix a, int unit)
+{
+	accmatrix p = a;
+
+	p.ld = bandld(a.ld, unit, sizeof(acc));
+	p.d = rawstorage((size_t)a.rows * p.ld * sizeof(acc));
+	placerows((char *)p.d, p.ld, (char *)a.d, a.ld, a.rows, a.cols, sizeof(acc), unit);
+	return p;
+}
+#endif
+
+/* copy of a with its pages spread over all nodes */
+matrix NumaSpread(matrix a)
+{
+	matrix p = a;
+	long i;
+
+	p.d = rawstorage((size_t)a.rows * a.ld * sizeof(elem));
+#ifdef MM_NUMA
+	if (NumaNodes() > 1)
+		numa_interleave_memory(p.d, (size_t)a.rows * a.ld * sizeof(elem),
+			numa_all_nodes_ptr);
+#endif
+
+	#pragma omp parallel for schedule(static)
+	for (i = 0; i < a.rows; i++)
+		memcpy(ROW(p, i), ROW(a, i), a.ld * sizeof(elem));
+	return p;
+}
@@ -0,0 +1,41 @@
+/*
+ * mm_numa.h
+ *
+ * Header file for the NUMA placement of matrices.
+ */
+
+#ifndef MM_NUMA_H
+#define MM_NUMA_H
+
+#include "mm_matrix.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The threads of a team of nthreads are assigned to the nodes in
+ * contiguous groups, thread t to node t*nodes/nthreads, and n items,
+ * such as the tile rows of a matrix, in contiguous ranges of equal
+ * size to the threads, so that every node owns one band of items:
+ * items NumaFirst(d) up to NumaFirst(d+1) - 1 of node d.
+ */
+
+int NumaNodes(void);		/* nodes of the machine, 1 if not NUMA */
+int NumaNode(int, int);		/* node of thread t of nthreads */
+int NumaFirst(int, int, int);	/* first of n items of node d, nthreads */
+void NumaBind(void);		/* bind the calling OpenMP thread to its node */
+matrix NumaRows(matrix, int);	/* a placed by bands of rows of unit rows */
+matrix NumaSpread(matrix);	/* a interleaved over all nodes */
+
+#ifdef MM_INT8
+accmatrix NumaAccRows(accmatrix, int);	/* same as NumaRows for results */
+#else
+#define NumaAccRows NumaRows
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MM_NUMA_H */
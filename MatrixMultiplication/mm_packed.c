@@ -0,0 +1,200 @@
+/*
+ * mm_packed.c
+ *
+ * Driver for the cache-blocked, packed matrix multiplication of
+ * mm_gemm.c, the high-throughput classical baseline the recursive
+ * algorithms are compared against.
+ *
+ * With -t, -a or -b the program runs the BLAS style gemm() instead,
+ *
+ *	c = alpha*op(a)*op(b) + beta*c
+ *
+ * where -t gives the transpose characters of a and b, N, T or C, and
+ * the size is that of op(a)*op(b), so that a and b are drawn, or must
+ * be stored, transposed as the characters say.  c starts out as NaN if
+ * beta is zero, which gemm() must overwrite without reading, and as a
+ * small pattern c0 otherwise.  -v then checks (c - beta*c0)/alpha
+ * against op(a)*op(b) formed explicitly, or c - beta*c0 against zero
+ * if alpha is zero.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <complex.h>
+#include <omp.h>
+#include "mm_gemm.h"
+#include "mm_file.h"
+#include "mm_verify.h"
+
+/* op(x) for transpose character t, as a new matrix */
+static matrix opmatrix(matrix x, char t)
+{
+	int trans = toupper(t) != 'N', i, j;
+	matrix y = newmatrix(trans ? x.cols : x.rows, trans ? x.rows : x.cols);
+
+	for (i = 0; i < y.rows; i++)
+		for (j = 0; j < y.cols; j++) {
+			elem e = trans ? ELEM(x, j, i) : ELEM(x, i, j);
+#ifdef MM_COMPLEX
+			if (toupper(t) == 'C')
+				e = conj(e);
+#endif
+			ELEM(y, i, j) = e;
+		}
+	return y;
+}
+
+/* initial c of gemm: NaN if it must not be read, else a small pattern */
+static void initc(accmatrix c, int nan)
+{
+	int i, j;
+
+	for (i = 0; i < c.rows; i++)
+		for (j = 0; j < c.cols; j++)
+#ifdef MM_INT8
+			ELEM(c, i, j) = (i + 2 * j) % 7 - 3;
+#else
+			ELEM(c, i, j) = nan ? NAN : ((i + 2 * j) % 7 - 3) / 4.;
+#endif
+}
+
+/* c = alpha*op(a)*op(b) + beta*c by gemm(), timed, checked if verify */
+static int rungemm(matrix a, matrix b, accmatrix c, char *ops, char *alphas,
+	char *betas, char *size, int verify)
+{
+	struct timeval ts,tf;
+	double tt;
+	acc alpha = atof(alphas), beta = atof(betas);
+	accmatrix c0 = newaccmatrix(c.rows, c.cols);
+	matrix oa, ob;
+	int i, j, ok = 1;
+
+	initc(c0, beta == 0);
+	for (i = 0; i < c.rows; i++)
+		memcpy(ROW(c, i), ROW(c0, i), c.cols * sizeof(acc));
+
+	gettimeofday(&ts,NULL);
+	gemm(ops[0], ops[1], alpha, a, b, beta, c);
+	gettimeofday(&tf,NULL);
+	tt=(tf.tv_sec-ts.tv_sec)+(tf.tv_usec-ts.tv_usec)*0.000001;
+
+	printf("Gemm Size %s Op %s Alpha %s Beta %s Threads %d Kernel %s Time %lf\n",
+		size,ops,alphas,betas,omp_get_max_threads(),LeafKernel(),tt);
+	writeresult(c,"gemm",size);
+
+	if (verify) {
+		oa = opmatrix(a, ops[0]);
+		ob = opmatrix(b, ops[1]);
+		if (alpha == 0)
+			memset(oa.d, 0, (size_t)oa.rows * oa.ld * sizeof(elem));
+		for (i = 0; i < c.rows; i++)
+			for (j = 0; j < c.cols; j++) {
+				acc d = beta != 0 ? ELEM(c, i, j) - beta * ELEM(c0, i, j)
+					: ELEM(c, i, j);
+				ELEM(c, i, j) = alpha != 0 ? d / alpha : d;
+			}
+		ok = Verify(oa, ob, c);
+		freematrix(oa);
+		freematrix(ob);
+	}
+	freeaccmatrix(c0);
+	return ok;
+}
+
+int main(int argc, char **argv) {
+	struct timeval ts,tf;
+	double tt;
+	int m, k, n, opt, verify = 0, ok = 1, blas = 0, ta, tb;
+	char size[40], *afile = NULL, *bfile = NULL;
+	char *ops = "NN", *alphas = "1", *betas = "0";
+	matrix a, b;
+	accmatrix c;
+	blocking bl = CacheBlocking();
+
+	while ((opt = getopt(argc, argv, "M:K:N:A:B:t:a:b:v")) != -1) {
+		switch (opt) {
+		case 'M':
+			bl.mc = atoi(optarg);
+			break;
+		case 'K':
+			bl.kc = atoi(optarg);
+			break;
+		case 'N':
+			bl.nc = atoi(optarg);
+			break;
+		case 'A':
+			afile = optarg;
+			break;
+		case 'B':
+			bfile = optarg;
+			break;
+		case 'v':
+			verify = 1;
+			break;
+		case 't':
+			ops = optarg;
+			blas = 1;
+			break;
+		case 'a':
+			alphas = optarg;
+			blas = 1;
+			break;
+		case 'b':
+			betas = optarg;
+			blas = 1;
+			break;
+		default:
+			check(0, "main: usage: packed [-M mc] [-K kc] [-N nc] [-t NN|NT|TN|..|CC] [-a alpha] [-b beta] [-v] {size | -A file -B file}");
+		}
+	}
+	check(bl.mc > 0 && bl.kc > 0 && bl.nc > 0, "main: Block sizes must be positive");
+	check(strlen(ops) == 2, "main: -t takes two transpose characters");
+	ta = toupper(ops[0]) != 'N';
+	tb = toupper(ops[1]) != 'N';
+	if (blas && (afile != NULL || bfile != NULL)) {
+		check(afile != NULL && bfile != NULL, "main: Need both -A and -B");
+		a = readmatrix(afile);	/* stored as -t says */
+		b = readmatrix(bfile);
+	}
+	else if (afile != NULL || bfile != NULL)
+		readoperands(afile, bfile, &a, &b);	/* size of the files */
+	else {
+		check(argc - optind >= 1, "main: Need matrix size on command line");
+		parsesize(argv[optind++], &m, &k, &n);
+		a = ta ? newmatrix(k, m) : newmatrix(m, k);
+		b = tb ? newmatrix(n, k) : newmatrix(k, n);
+		randomfill(a, SEEDA);
+		randomfill(b, SEEDB);
+	}
+	m = ta ? a.cols : a.rows;
+	k = ta ? a.rows : a.cols;
+	n = tb ? b.rows : b.cols;
+	sizename(size, m, k, n);
+	c = newaccmatrix(m, n);
+
+	if (blas)
+		ok = rungemm(a, b, c, ops, alphas, betas, size, verify);
+	else {
+		gettimeofday(&ts,NULL);
+		PackedMult(a, b, c, bl);
+		gettimeofday(&tf,NULL);
+		tt=(tf.tv_sec-ts.tv_sec)+(tf.tv_usec-ts.tv_usec)*0.000001;
+
+		printf("Packed Size %s MC %d KC %d NC %d Threads %d Kernel %s Time %lf\n",
+			size,bl.mc,bl.kc,bl.nc,omp_get_max_threads(),LeafKernel(),tt);
+
+		writeresult(c,"packed",size);
+		if (verify)
+			ok = Verify(a, b, c);
+	}
+
+	freeoperand(a);
+	freeoperand(b);
+	freeaccmatrix(c);
+	return ok ? 0 : 1;
+}
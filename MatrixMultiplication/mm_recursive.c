@@ -1,272 +1,389 @@
-
 /*
  * mm_recursive.c
  *
  * Routines to realize the recursive matrix multiplication.
- * RecMult multiplies n by n matrices a and b, putting the result in c, and
- * using the matrix d as scratch space.  The recursive algorithm is: 
+ * RecMult multiplies the m by k matrix a by the k by n matrix b, putting
+ * the result in c.  The recursive algorithm halves the largest of the
+ * three dimensions, as in cache-oblivious matrix multiplication:
+ *
+ *      m largest:      c1 = a1 * b,  c2 = a2 * b       (split by rows)
+ *      n largest:      c1 = a * b1,  c2 = a * b2       (split by columns)
+ *      k largest:      c = a1 * b1,  c = c + a2 * b2
+ *
+ * where a1, a2 are the top/bottom or left/right halves of a in an
+ * obvious way, and likewise for b and c.  Every subproblem is thus as
+ * close to a cube as possible, whatever the shape of the matrices, so
+ * tall-skinny and short-wide products keep the locality of square ones
+ * without being padded.  For square matrices three consecutive levels
+ * amount to the classical eight half-size products.
  *
- *      d11 = a11 * b11
- *      c11 = a12 * b21
- *      d12 = a11 * b12
- *      c12 = a12 * b22
- *      d21 = a21 * b11
- *      c21 = a22 * b21
- *      d22 = a21 * b12
- *      c22 = a22 * b22
- *      c11 = c11 + d11
- *      c12 = c12 + d12
- *      c21 = c21 + d21
- *      c22 = c22 + d22
+ * The k split accumulates into c, so the serial recursion needs no
+ * scratch space at all.
  *
- * where the double indices refer to submatrices in an obvious way.
- * Each line of RecMult() that recursively calls itself computes one
- * of the submatrices.  Four scratch half-size matrices are required by the
- * sequence of computations here.
+ * The quadrants of a row-major matrix are views whose rows lie ld
+ * elements apart, so the recursion is cache-oblivious only down to
+ * rows of a quadrant.  MortonMult() (-a morton) works on copies of
+ * the matrices in Morton order instead, see mm_morton.h, where every
+ * quadrant or half is one contiguous slice and every tile a compact
+ * block.  Each of m, k, n is padded to a power of two of tiles of its
+ * own, and the recursion halves at each level those of the three that
+ * have the most tiles, as the layout of the grids has it: all three of
+ * a cube, into the classical eight products of quadrants, and only the
+ * longest of a skewed product.  The copies cost O(mk + kn + mn); the
+ * padding less than doubles each side, or rounds it up to one tile.
+ * With MM_OUTPUT=morton, see mm_file.c, the result file has tiles of
+ * block as well, and operand files in Morton order with tiles of block,
+ * or of any size without a block on the command line, are used as
+ * mapped without any conversion.
+ * Strassen works on row-major matrices only, and the int8 build has no
+ * -a morton, as Morton storage holds operands and not int32 results.
  *
- * The small matrix computations (i.e., for n <= block) can be
- * optimized considerably from those given here; in particular, this
- * is important to do before the value of block is chosen optimally. 
+ * The small matrix computations (i.e., for m, k, n <= block) are done by
+ * the packed, vectorized leaf kernel of mm_kernel.c.
+ *
+ * Without a block size on the command line the program takes the one
+ * from the tuning file of mm_tune.c, and the thread count as well for
+ * the parallel version; -T tunes them anew.
  *
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <sys/time.h>
 #include "mm_recursive.h"
-
-matrix newmatrix(int);		/* allocate storage */
-void freematrix (matrix, int); /*free storage */
-void randomfill(int, matrix);	/* fill with random values in the the range [0,1) */
-void auxrandomfill(int, matrix, int, int);
-void print (int, matrix, FILE *); /*print matrix in file*/
-void auxprint(int, matrix, FILE *, int, int );
-void check(int, char *);	/* check for error conditions */
+#include "mm_tune.h"
+#include "mm_file.h"
+#include "mm_verify.h"
 
 int block;
 
-int main(int argc, char **argv) {
-
-    struct timeval ts,tf;
-    double tt;
-    int n;
-    matrix a, b, c;
-
-    check(argc >= 3, "main: Need matrix size and block size on command line");
-    n = atoi(argv[1]);
-    block=atoi(argv[2]);
+/* algorithms selectable with -a */
+enum { SERIAL, PARALLEL, MORTON, NALGOS };
+static char *algos[NALGOS] = { "serial", "parallel", "morton" };
 
-    a = newmatrix(n);
-    b = newmatrix(n);
-    c = newmatrix(n);
-    randomfill(n, a);
-    randomfill(n, b);
-
-    gettimeofday(&ts,NULL);
-    RecMult(n, a, b, c);	/* strassen algorithm */
-    gettimeofday(&tf,NULL);
-    tt=(tf.tv_sec-ts.tv_sec)+(tf.tv_usec-ts.tv_usec)*0.000001;
-
-    printf("Recursive Size %d Block %d Time %lf\n",n,block,tt);
-
-    char *filename=malloc(30*sizeof(char));
-    sprintf(filename,"res_mm_recursive_%d",n);
-    FILE * f=fopen(filename,"w");
-    print(n,c,f);
-    fclose(f);
-
-    freematrix(a,n);
-    freematrix(b,n);
-    freematrix(c,n);
-
-    return 0;
-}
+/* operands of the program, and the algorithm, for trial() */
+static matrix a, b;
+static accmatrix c;
+static int algo = SERIAL, pardepth = 9;
+static double tconvert;		/* time of the conversions to Morton order */
+#ifndef MM_INT8
+static zmatrix ma, mb;		/* operand files mapped, see mapoperands() */
+#endif
 
-/* c = a*b */
-void RecMult(int n, matrix a, matrix b, matrix c)
+/*
+ * c = a*b with the algorithm selected.  The Morton version converts
+ * a and b to Morton order with tiles of block by block, unless they
+ * are mapped as ma and mb already, and c back, and the time that takes
+ * goes to tconvert.
+ */
+static void multiply(void)
 {
-
-    matrix d;
-
-    if (n <= block) {
-        double sum, **p = a->d, **q = b->d, **r = c->d;
-        int i, j, k;
-
-        for (i = 0; i < n; i++) {
-            for (j = 0; j < n; j++) {
-                for (sum = 0., k = 0; k < n; k++)
-                    sum += p[i][k] * q[k][j];
-                r[i][j] = sum;
-            }
+#ifndef MM_INT8
+    zmatrix za, zb, zc;
+    double t;
+#endif
+
+    switch (algo) {
+    case PARALLEL:
+        ParRecMult(a, b, c, pardepth);	/* task-parallel recursion */
+        break;
+#ifndef MM_INT8
+    case MORTON:
+        zc = newzmatrix(c.rows, c.cols, block);
+        tconvert = 0;
+        if (ma.d != NULL) {
+            za = ma;
+            zb = mb;
         }
-    } 
-    else {
-        d=newmatrix(n);
-        n /= 2;
-        RecMult(n, a11, b11, d11);
-        RecMult(n, a12, b21, c11);
-        RecAdd(n, d11, c11, c11);
-        RecMult(n, a11, b12, d12);
-        RecMult(n, a12, b22, c12);
-        RecAdd(n, d12, c12, c12);
-        RecMult(n, a21, b11, d21);
-        RecMult(n, a22, b21, c21);
-        RecAdd(n, d21, c21, c21);
-        RecMult(n, a21, b12, d22);
-        RecMult(n, a22, b22, c22);
-        RecAdd(n, d22, c22, c22);
-        freematrix(d,n*2);
+        else {
+            za = newzmatrix(a.rows, a.cols, block);
+            zb = newzmatrix(b.rows, b.cols, block);
+            t = seconds();
+            tomorton(a, za);
+            tomorton(b, zb);
+            tconvert = seconds() - t;
+        }
+        MortonMult(za, zb, zc);	/* recursion on contiguous quadrants */
+        t = seconds();
+        frommorton(zc, c);
+        tconvert += seconds() - t;
+        if (ma.d == NULL) {
+            freezmatrix(za);
+            freezmatrix(zb);
+        }
+        freezmatrix(zc);
+        break;
+#endif
+    default:
+        RecMult(a, b, c);	/* recursive algorithm */
     }
 }
 
-/* c = a+b */
-void RecAdd(int n, matrix a, matrix b, matrix c) {
-    if (n <= block) {
-        double **p = a->d, **q = b->d, **r = c->d;
-        int i, j;
-        for (i = 0; i < n; i++) 
-            for (j = 0; j < n; j++) 
-                r[i][j] = p[i][j] + q[i][j];
-    } 
-    else {
-        n /= 2;
-        RecAdd(n, a11, b11, c11);
-        RecAdd(n, a12, b12, c12);
-        RecAdd(n, a21, b21, c21);
-        RecAdd(n, a22, b22, c22);
-    }
+/*
+ * time the leading m by k by n part of c = a*b with block size blk
+ * and threads threads, for Tune()
+ */
+static double trial(int blk, int threads, int m, int k, int n)
+{
+    matrix sa = a, sb = b;
+    accmatrix sc = c;
+    double t;
+
+    block = blk;
+    if (algo == PARALLEL)
+        ParInit(threads);
+    a = submatrix(sa, 0, 0, m, k);
+    b = submatrix(sb, 0, 0, k, n);
+    c = accsubmatrix(sc, 0, 0, m, n);
+    t = seconds();
+    multiply();
+    t = seconds() - t;
+    a = sa;
+    b = sb;
+    c = sc;
+    return t;
 }
 
-/* Recursive randomfill -- possibly useful for NUMA archs*/
-/* Fill the matrix a with random values between 0 and 1 */
+#ifndef MM_INT8
 /*
-   void randomfill(int n, matrix a) {
-   if (n <= block) {
-   int i, j;
-   double **p = a->d, T = -(double)(1 << 31);
-
-   for (i = 0; i < n; i++)
-   for (j = 0; j < n; j++)
-   p[i][j] = random() / T;
-   } 
-   else {
-   n /= 2;
-   randomfill(n, a11);
-   randomfill(n, a12);
-   randomfill(n, a21);
-   randomfill(n, a22);
-   }
-   }
-   */
-
+ * Map the operand files fa and fb as ma and mb, instead of reading
+ * them into a and b, if both are Morton files with tiles of blk, or of
+ * the same size if blk is 0.  Return the tile, or 0 if they are not.
+ */
+static int mapoperands(char *fa, char *fb, int blk)
+{
+    int tile;
+
+    if (fa == NULL || fb == NULL || (tile = mortontile(fa)) == 0
+            || mortontile(fb) != tile || (blk > 0 && blk != tile))
+        return 0;
+    ma = mapzmatrix(fa);
+    mb = mapzmatrix(fb);
+    check(ma.cols == mb.rows, "mapoperands: nonconformant matrices");
+    return tile;
+}
+#endif
 
-/* fill n by n matrix with random numbers */
-void randomfill(int n, matrix a) {
-    int i,j;
-    double T = -(double)(1 << 31);
+int main(int argc, char **argv) {
 
-    if (n <= block) {
-        for (i = 0; i < n; i++)
-            for (j = 0; j < n; j++)
-                a->d[i][j] = rand() / T;
-    } 		
+    struct timeval ts,tf;
+    double tt;
+    int m, k, n, opt, nthreads = 0, retune = 0, verify = 0, ok = 1;
+    char size[40], engine[64], *afile = NULL, *bfile = NULL;
+    tuning t;
+
+    while ((opt = getopt(argc, argv, "a:d:t:A:B:Tv")) != -1) {
+        switch (opt) {
+        case 'a':
+            for (algo = 0; algo < NALGOS; algo++)
+                if (!strcmp(optarg, algos[algo]))
+                    break;
+            check(algo < NALGOS, "main: Unknown algorithm");
+#ifdef MM_INT8
+            check(algo != MORTON, "main: No Morton order for int8 results");
+#endif
+            break;
+        case 'd':
+            pardepth = atoi(optarg);
+            break;
+        case 't':
+            nthreads = atoi(optarg);
+            break;
+        case 'A':
+            afile = optarg;
+            break;
+        case 'B':
+            bfile = optarg;
+            break;
+        case 'v':
+            verify = 1;
+            break;
+        case 'T':
+            retune = 1;
+            break;
+        default:
+            check(0, "main: usage: recursive [-a serial|parallel|morton] [-d depth] [-t threads] [-T] [-v] {size | -A file -B file} [block]");
+        }
+    }
+#ifndef MM_INT8
+    /* Morton files in tiles of the block need no conversion, see above */
+    if (algo == MORTON && (block = mapoperands(afile, bfile,
+            argc - optind >= 1 ? atoi(argv[optind]) : 0)) > 0) {
+        a.rows = ma.rows;
+        a.cols = b.rows = ma.cols;
+        b.cols = mb.cols;
+    }
+    else
+#endif
+    if (afile != NULL || bfile != NULL)
+        readoperands(afile, bfile, &a, &b);	/* size of the files */
     else {
-        for (i=0;i<n;i++)
-            for (j=0;j<n;j++) 
-                auxrandomfill(n,a,i,j);
+        check(argc - optind >= 1, "main: Need matrix size on command line");
+        parsesize(argv[optind++], &m, &k, &n);
+        a = newmatrix(m, k);
+        b = newmatrix(k, n);
+        randomfill(a, SEEDA);
+        randomfill(b, SEEDB);
     }
-}
-
-void auxrandomfill(int n, matrix a, int i, int j) {
+    m = a.rows;
+    k = a.cols;
+    n = b.cols;
+    sizename(size, m, k, n);
+    if (a.d != NULL)	/* else the tile of the mapped files */
+        block = argc - optind >= 1 ? atoi(argv[optind]) : 0;
+    c = newaccmatrix(m, n);
+
+    if (algo == PARALLEL)
+        ParInit(nthreads);
+
+    /*
+     * Without a block size use the tuned one, tuning first if need be.
+     * -t, if given, wins over the tuned thread count.
+     */
+    if (block <= 0) {
+        sprintf(engine, "recursive" ELEMSUFFIX "-%s", algos[algo]);
+        if (retune || !LoadTuning(engine, m, k, n, &t)) {
+            t = Tune(trial, m, k, n, algo == PARALLEL ? ParThreads() : 1);
+            SaveTuning(engine, m, k, n, t);
+        }
+        block = t.block;
+        if (algo == PARALLEL)
+            ParInit(nthreads > 0 ? nthreads : t.threads);
+    }
+    if (algo == MORTON)
+        resulttile = block;	/* for MM_OUTPUT=morton */
 
-    double T = -(double)(1 << 31);
-    if (n<=block) 
-        a->d[i][j]=rand()/T;
-    else 
-        auxrandomfill(n/2,a->p[(i>=n/2)*2+(j>=n/2)],i%(n/2),j%(n/2));
-}
+    gettimeofday(&ts,NULL);
+    multiply();
+    gettimeofday(&tf,NULL);
+    tt=(tf.tv_sec-ts.tv_sec)+(tf.tv_usec-ts.tv_usec)*0.000001;
 
-/* return new square n by n matrix */
-matrix newmatrix(int n) {
+    switch (algo) {
+    case PARALLEL:
+        printf("Parallel Recursive Size %s Block %d Depth %d Threads %d Time %lf\n",
+                size,block,pardepth,ParThreads(),tt);
+        break;
+    case MORTON:
+        printf("Morton Recursive Size %s Block %d Convert %lf Time %lf\n",
+                size,block,tconvert,tt - tconvert);
+        break;
+    default:
+        printf("Recursive Size %s Block %d Time %lf\n",size,block,tt);
+    }
 
-    matrix a;
-    a = (matrix)malloc(sizeof(*a));
-    check(a != NULL, "newmatrix: out of space for matrix");
-    if (n <= block) {
-        int i;
-        a->d = (double **)calloc(n, sizeof(double *));
-        check(a->d != NULL,
-                "newmatrix: out of space for row pointers");
-        for (i = 0; i < n; i++) {
-            a->d[i] = (double *)calloc(n, sizeof(double));
-            check(a != NULL, "newmatrix: out of space for rows");
+    writeresult(c,"recursive",size);
+#ifndef MM_INT8
+    if (ma.d != NULL) {
+        if (verify) {
+            a = newmatrix(m, k);
+            b = newmatrix(k, n);
+            frommorton(ma, a);
+            frommorton(mb, b);
         }
-    } 
-    else {
-        n /= 2;
-        a->p = (matrix *)calloc(4, sizeof(matrix));
-        check(a->p != NULL,"newmatrix: out of space for submatrices");
-        a11 = newmatrix(n);
-        a12 = newmatrix(n);
-        a21 = newmatrix(n);
-        a22 = newmatrix(n);
+        unmapzmatrix(ma);
+        unmapzmatrix(mb);
     }
-    return a;
-}
+#endif
+    if (verify)
+        ok = Verify(a, b, c);
 
-/* free square n by n matrix m */
-void freematrix (matrix m, int n) {
-    if (n<=block) {
-        int i;
-        for (i=0;i<n;i++)
-            free(m->d[i]);
-        free(m->d);
-    }
-    else {
-        n/=2;	
-        freematrix(m->p[0],n);
-        freematrix(m->p[1],n);
-        freematrix(m->p[2],n);
-        freematrix(m->p[3],n);
+    if (a.d != NULL) {
+        freeoperand(a);
+        freeoperand(b);
     }
+    freeaccmatrix(c);
+    return ok ? 0 : 1;
 }
 
-/* print n by n matrix into file f*/
-void print(int n, matrix a, FILE * f) {
-    int i,j;
+/* c = a*b, or c = c + a*b if add is set */
+static void recmult(matrix a, matrix b, accmatrix c, int add)
+{
+    int m = c.rows, n = c.cols, k = a.cols;
 
-    if (n <= block) {
-        for (i = 0; i < n; i++) {
-            for (j = 0; j < n; j++)
-                fprintf(f,"%lf ",a->d[i][j]);
-            fprintf(f,"\n");	
-        }
-    } 		
+    if (m <= block && n <= block && k <= block) {
+        if (add)
+            LeafMultAdd(a, b, c);
+        else
+            LeafMult(a, b, c);
+    }
+    else if (m >= n && m >= k) {
+        recmult(TOP(a), b, ACCTOP(c), add);
+        recmult(BOTTOM(a), b, ACCBOTTOM(c), add);
+    }
+    else if (n >= k) {
+        recmult(a, LEFT(b), ACCLEFT(c), add);
+        recmult(a, RIGHT(b), ACCRIGHT(c), add);
+    }
     else {
-        for (i=0;i<n;i++) {
-            for (j=0;j<n;j++) 
-                auxprint(n,a,f,i,j);
-            fprintf(f,"\n");
-        }
+        recmult(LEFT(a), TOP(b), c, add);
+        recmult(RIGHT(a), BOTTOM(b), c, 1);
     }
 }
 
-void auxprint(int n, matrix a, FILE * f, int i, int j) {
-
-    if (n<=block) 
-        fprintf(f,"%lf ",a->d[i][j]);
-    else 
-        auxprint(n/2,a->p[(i>=n/2)*2+(j>=n/2)],f,i%(n/2),j%(n/2));
+/* c = a*b */
+void RecMult(matrix a, matrix b, accmatrix c)
+{
+    recmult(a, b, c, 0);
 }
 
+#ifndef MM_INT8
 /*
- * If the expression e is false print the error message s and quit. 
+ * c = a*b, or c = c + a*b if add is set, for Morton parts of 2^lm by
+ * 2^lk and 2^lk by 2^ln tiles, whose first tiles are tile row i and
+ * column p of the whole of a and tile column j of b.  The dimensions
+ * with the most levels are halved, which splits each of a, b and c
+ * into its quadrants, its halves or not at all, as its layout does.
+ * Products of parts that hold nothing but padding are skipped.
  */
+static void zmult(zmatrix a, zmatrix b, zmatrix c, int i, int p, int j,
+        int lm, int lk, int ln, int add)
+{
+    int l = lm > lk ? (lm > ln ? lm : ln) : (lk > ln ? lk : ln);
+    int sm = lm == l, sk = lk == l, sn = ln == l;	/* dimensions halved */
+    int h = 1 << l >> 1;	/* their halves in tiles */
+    int x, y, q;
+
+    if (i * a.tile >= a.rows || p * a.tile >= a.cols || j * b.tile >= b.cols) {
+        if (!add)
+            memset(c.d, 0, ZSIZE(c, lm, ln) * sizeof(elem));
+        return;
+    }
+    if (l == 0) {
+        if (add)
+            LeafMultAdd(ztile(a, 0), ztile(b, 0), ztile(c, 0));
+        else
+            LeafMult(ztile(a, 0), ztile(b, 0), ztile(c, 0));
+        return;
+    }
 
-void check(int e, char *s)
+    for (x = 0; x <= sm; x++)
+        for (y = 0; y <= sn; y++)
+            for (q = 0; q <= sk; q++)
+                zmult(zpart(a, lm, lk, sm, sk, x, q), zpart(b, lk, ln, sk, sn, q, y),
+                        zpart(c, lm, ln, sm, sn, x, y), i + x * h, p + q * h, j + y * h,
+                        lm - sm, lk - sk, ln - sn, q > 0 || add);
+}
+
+/* c = a*b for matrices in Morton order with matching grids */
+void MortonMult(zmatrix a, zmatrix b, zmatrix c)
 {
-    if (!e) {
-        fprintf(stderr, "Fatal error -> %s\n", s);
-        exit(1);
+    check(a.tile == b.tile && b.tile == c.tile && a.rlevels == c.rlevels
+            && a.clevels == b.rlevels && b.clevels == c.clevels,
+            "MortonMult: different tile grids");
+    check(a.cols == b.rows && a.rows == c.rows && b.cols == c.cols,
+            "MortonMult: nonconformant matrices");
+    zmult(a, b, c, 0, 0, 0, a.rlevels, a.clevels, b.clevels, 0);
+}
+#endif
+
+/* c = a+b */
+void RecAdd(accmatrix a, accmatrix b, accmatrix c) {
+    int i, j;
+    for (i = 0; i < c.rows; i++) {
+        acc *p = ROW(a, i), *q = ROW(b, i), *r = ROW(c, i);
+        for (j = 0; j < c.cols; j++) 
+            r[j] = p[j] + q[j];
     }
 }
@@ -5,47 +5,51 @@
  */
 
 /*
- * Square matrices of size <= block are handled with the ``classical
- * algorithms.  The shape of almost all functions is therefore
- * something like
+ * Products whose dimensions are all <= block are handled with the
+ * ``classical'' algorithms, i.e. the leaf kernel of mm_kernel.h.  The
+ * shape of almost all functions is therefore something like
  *
- *	if ( n <= block )
+ *	if ( m, k, n <= block )
  *	    classical algorithms
  *	else
- *	    n/= 2
- *	    recursive call for 4 half-size submatrices
+ *	    halve the largest of m, k, n
+ *	    recursive call for the 2 half-size products
  */
 
+#include "mm_matrix.h"
+#include "mm_kernel.h"
+#include "mm_morton.h"
 
-typedef union _matrix {
-    double **d;
-    union _matrix **p;
-} *matrix;
+extern int block;
 
+#ifdef __cplusplus
+extern "C" {
+#endif
 
+void RecMult(matrix, matrix, accmatrix);
+void RecAdd(accmatrix, accmatrix, accmatrix);
+void MortonMult(zmatrix, zmatrix, zmatrix);	/* c = a*b in Morton order */
 
-void RecMult(int, matrix, matrix, matrix);
-void RecAdd(int, matrix, matrix, matrix);
+/* task-parallel version, mm_recursive_tbb.cpp */
+void ParRecMult(matrix, matrix, accmatrix, int);
+
+#ifdef __cplusplus
+}
+#endif
 
 /*
- * Notational shorthand to access submatrices for matrices named
- * a,b,c,d 
+ * Notational shorthand for the two halves of matrix x when it is split
+ * by rows (x1 on top of x2) or by columns (x1 left of x2).  The first
+ * half gets the extra row or column when the size is odd.
  */
 
-#define a11 a->p[0]
-#define a12 a->p[1]
-#define a21 a->p[2]
-#define a22 a->p[3]
-#define b11 b->p[0]
-#define b12 b->p[1]
-#define b21 b->p[2]
-#define b22 b->p[3]
-#define c11 c->p[0]
-#define c12 c->p[1]
-#define c21 c->p[2]
-#define c22 c->p[3]
-#define d11 d->p[0]
-#define d12 d->p[1]
-#define d21 d->p[2]
-#define d22 d->p[3]
+#define TOP(x) submatrix(x, 0, 0, ((x).rows + 1) / 2, (x).cols)
+#define BOTTOM(x) submatrix(x, ((x).rows + 1) / 2, 0, (x).rows / 2, (x).cols)
+#define LEFT(x) submatrix(x, 0, 0, (x).rows, ((x).cols + 1) / 2)
+#define RIGHT(x) submatrix(x, 0, ((x).cols + 1) / 2, (x).rows, (x).cols / 2)
 
+/* the same for results */
+#define ACCTOP(x) accsubmatrix(x, 0, 0, ((x).rows + 1) / 2, (x).cols)
+#define ACCBOTTOM(x) accsubmatrix(x, ((x).rows + 1) / 2, 0, (x).rows / 2, (x).cols)
+#define ACCLEFT(x) accsubmatrix(x, 0, 0, (x).rows, ((x).cols + 1) / 2)
+#define ACCRIGHT(x) accsubmatrix(x, 0, ((x).cols + 1) / 2, (x).rows, (x).cols / 2)
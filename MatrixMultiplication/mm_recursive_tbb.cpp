@@ -0,0 +1,58 @@
+/*
+ * mm_recursive_tbb.cpp
+ *
+ * Task-parallel recursive matrix multiplication on top of the TBB
+ * work-stealing scheduler.
+ *
+ * The halves of a split by rows or by columns write disjoint halves
+ * of c, so they run as two tasks of a task_group.  The two halves of a
+ * k split both contribute to all of c; one of them is computed into a
+ * scratch matrix d instead, so that they can run concurrently too, and
+ * c = c + d follows as a second group.  Idle threads steal whole
+ * subtrees of the recursion, which keeps the stolen work coarse.
+ *
+ * Spawning stops pardepth levels below the top, where the serial
+ * RecMult() takes over; this cutoff is independent of block, which
+ * only sets the size of the classical leaf computations.  Each level
+ * halves one dimension, so three levels correspond to one level of
+ * the classical eight-product recursion.
+ */
+
+#include <tbb/task_group.h>
+#include "mm_recursive.h"
+
+/* c = a*b, spawning tasks for the top pardepth levels */
+void ParRecMult(matrix a, matrix b, accmatrix c, int pardepth)
+{
+    int m = c.rows, n = c.cols, k = a.cols;
+    accmatrix d;
+    tbb::task_group g;
+
+    if ((m <= block && n <= block && k <= block) || pardepth <= 0) {
+        RecMult(a, b, c);
+        return;
+    }
+
+    pardepth--;
+    if (m >= n && m >= k) {
+        g.run([=] { ParRecMult(TOP(a), b, ACCTOP(c), pardepth); });
+        ParRecMult(BOTTOM(a), b, ACCBOTTOM(c), pardepth);
+        g.wait();
+    }
+    else if (n >= k) {
+        g.run([=] { ParRecMult(a, LEFT(b), ACCLEFT(c), pardepth); });
+        ParRecMult(a, RIGHT(b), ACCRIGHT(c), pardepth);
+        g.wait();
+    }
+    else {
+        d = newaccmatrix(m, n);
+        g.run([=] { ParRecMult(LEFT(a), TOP(b), c, pardepth); });
+        ParRecMult(RIGHT(a), BOTTOM(b), d, pardepth);
+        g.wait();
+
+        g.run([=] { RecAdd(ACCTOP(d), ACCTOP(c), ACCTOP(c)); });
+        RecAdd(ACCBOTTOM(d), ACCBOTTOM(c), ACCBOTTOM(c));
+        g.wait();
+        freeaccmatrix(d);
+    }
+}
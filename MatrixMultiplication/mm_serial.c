@@ -1,126 +1,150 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <sys/time.h>
 #include <omp.h>
+#include "mm_matrix.h"
+#include "mm_file.h"
+#include "mm_verify.h"
+
+void SerialMult(matrix, matrix, accmatrix);	/* Serial Multiplication Algorithm */
+void ParallelMult(matrix, matrix, accmatrix);	/* OpenMP, i-k-j, register blocked */
 
 /*
- * A matrix is defined to be a pointer to a ``union _matrix'', which
- * is (if the size is <= BREAK) a matrix of numbers, or else is an
- * array of four submatrices of half size. 
+ * ParallelMult updates RB rows of c at once, so that every element of
+ * b loaded from memory is used RB times while still in a register, and
+ * sweeps the columns in panels of CB, so that the RB row segments of c
+ * being accumulated stay in L1 across the whole k loop.
  */
-
-typedef union _matrix {
-    double **d;
-    union _matrix **p;
-} *matrix;
-
-matrix newmatrix(int);		/* allocate storage */
-void randomfill(int, matrix);	/* fill with srandom values in the the range [0,1) */
-void freematrix(matrix, int);
-void print (matrix, int, FILE *);
-void SerialMult(int, matrix, matrix, matrix);	/* Serial Multiplication Algorithm */
-void check(int, char *);	/* check for error conditions */
-
+#define RB 4
+#define CB 256
 
 int main(int argc, char **argv) {
 	struct timeval ts,tf;
 	double tt;
-    	int n;
-    	matrix a, b, c;
-
-    	check(argc >= 2, "main: Need matrix size on command line");
-    	n = atoi(argv[1]);
-
-    	a = newmatrix(n);
-    	b = newmatrix(n);
-    	c = newmatrix(n);
-    	randomfill(n, a);
-    	randomfill(n, b);
+    	int m, k, n, opt, parallel = 0, verify = 0, ok = 1;
+	char size[40], *afile = NULL, *bfile = NULL;
+    	matrix a, b;
+	accmatrix c;
+
+	while ((opt = getopt(argc, argv, "a:A:B:v")) != -1) {
+		switch (opt) {
+		case 'a':
+			if (!strcmp(optarg, "parallel"))
+				parallel = 1;
+			else
+				check(!strcmp(optarg, "naive"), "main: Unknown algorithm");
+			break;
+		case 'A':
+			afile = optarg;
+			break;
+		case 'B':
+			bfile = optarg;
+			break;
+		case 'v':
+			verify = 1;
+			break;
+		default:
+			check(0, "main: usage: serial [-a naive|parallel] [-v] size | -A file -B file");
+		}
+	}
+	if (afile != NULL || bfile != NULL)
+		readoperands(afile, bfile, &a, &b);	/* size of the files */
+	else {
+		check(argc - optind >= 1, "main: Need matrix size on command line");
+		parsesize(argv[optind], &m, &k, &n);
+		a = newmatrix(m, k);
+		b = newmatrix(k, n);
+		randomfill(a, SEEDA);
+		randomfill(b, SEEDB);
+	}
+	m = a.rows;
+	k = a.cols;
+	n = b.cols;
+	sizename(size, m, k, n);
+	c = newaccmatrix(m, n);
 
 	gettimeofday(&ts,NULL);
-    	SerialMult(n, a, b, c);	/* Serial Multiplication */
+	if (parallel)
+		ParallelMult(a, b, c);	/* Parallel Multiplication */
+	else
+	    	SerialMult(a, b, c);	/* Serial Multiplication */
 	gettimeofday(&tf,NULL);
 	tt=(tf.tv_sec-ts.tv_sec)+(tf.tv_usec-ts.tv_usec)*0.000001;
 
-	printf("Serial Size %d Time %lf\n",n,tt);
-	char * filename=malloc(30*sizeof(char));
-	sprintf(filename,"res_mm_serial_%d",n);
-	FILE * f=fopen(filename,"w");
-	print(c,n,f);
-	fclose(f);
-
-	freematrix(a,n);
-	freematrix(b,n);
-	freematrix(c,n);	
-	return 0;
+	if (parallel)
+		printf("Parallel Size %s Threads %d Time %lf\n",size,omp_get_max_threads(),tt);
+	else
+		printf("Serial Size %s Time %lf\n",size,tt);
+	writeresult(c,"serial",size);
+	if (verify)
+		ok = Verify(a, b, c);
+
+	freeoperand(a);
+	freeoperand(b);
+	freeaccmatrix(c);
+	return ok ? 0 : 1;
 }
 
 /*c=a*b*/
-void SerialMult(int n, matrix a, matrix b, matrix c) {
-	double sum, **p = a->d, **q = b->d, **r = c->d;
+void SerialMult(matrix a, matrix b, accmatrix c) {
+	acc sum;
 	int i, j, k;
-	for (i = 0; i < n; i++) {
-		for (j = 0; j < n; j++) {
-			for (sum = 0., k = 0; k < n; k++)
-		    		sum += p[i][k] * q[k][j];
-			r[i][j] = sum;
+	for (i = 0; i < c.rows; i++) {
+		elem *p = ROW(a, i);
+		acc *r = ROW(c, i);
+		for (j = 0; j < c.cols; j++) {
+			for (sum = 0, k = 0; k < a.cols; k++)
+				sum += p[k] * ELEM(b, k, j);
+			r[j] = sum;
 		}
 	}
 }
- 	
-/* Fill the matrix a with srandom values between 0 and 1 */
-void randomfill(int n, matrix a) {
-	int i, j;
-	double **p = a->d;
-	double T = -(double)(1 << 31);
-
-	for (i = 0; i < n; i++)
-		for (j = 0; j < n; j++)
-			p[i][j] = rand() / T;
-}
-
-
-/* return new square n by n matrix */
-matrix newmatrix(int n) {
-    
-	matrix a;
-	a = (matrix)malloc(sizeof(*a));
-	check(a != NULL, "newmatrix: out of space for matrix");
-
-	int i;
-
-	a->d = (double **)calloc(n, sizeof(double *));
-	check(a->d != NULL,"newmatrix: out of space for row pointers");
-	for (i = 0; i < n; i++) {
-		a->d[i] = (double *)calloc(n, sizeof(double));
-		check(a != NULL, "newmatrix: out of space for rows");
-	}
- 
-	return a;
-}
-
-void freematrix(matrix a, int n) {
-	int i;
-	for (i=0;i<n;i++)
-		free(a->d[i]);
-	free(a);
-}
 
-void print (matrix a, int n, FILE * f) {
-	int i,j;
-	double **p=a->d;
-	for (i=0;i<n;i++) {
-		for (j=0;j<n;j++)
-			fprintf(f,"%lf ",p[i][j]);
-		fprintf(f,"\n");
-	}
-}
-
-
-void check(int e, char *s) {
-	if (!e) {
-		fprintf(stderr, "Fatal error -> %s\n", s);
-		exit(1);
+/* c=a*b, blocks of RB rows of c distributed over the threads */
+void ParallelMult(matrix a, matrix b, accmatrix c) {
+	int ii, m = c.rows, n = c.cols, kk = a.cols;
+
+	#pragma omp parallel for schedule(static)
+	for (ii = 0; ii < m; ii += RB) {
+		int i, j, k, jj, jend, rows = m - ii < RB ? m - ii : RB;
+
+		for (jj = 0; jj < n; jj += CB) {
+			jend = n - jj < CB ? n : jj + CB;
+			for (i = 0; i < rows; i++)
+				memset(ROW(c, ii + i) + jj, 0, (jend - jj) * sizeof(acc));
+
+			if (rows == RB) {
+				acc *restrict r0 = ROW(c, ii), *restrict r1 = ROW(c, ii + 1);
+				acc *restrict r2 = ROW(c, ii + 2), *restrict r3 = ROW(c, ii + 3);
+
+				for (k = 0; k < kk; k++) {
+					acc a0 = ELEM(a, ii, k), a1 = ELEM(a, ii + 1, k);
+					acc a2 = ELEM(a, ii + 2, k), a3 = ELEM(a, ii + 3, k);
+					const elem *restrict q = ROW(b, k);
+
+					for (j = jj; j < jend; j++) {
+						acc bkj = q[j];
+						r0[j] += a0 * bkj;
+						r1[j] += a1 * bkj;
+						r2[j] += a2 * bkj;
+						r3[j] += a3 * bkj;
+					}
+				}
+			}
+			else {
+				/* leftover rows when m is not a multiple of RB */
+				for (i = ii; i < ii + rows; i++) {
+					acc *restrict r = ROW(c, i);
+					for (k = 0; k < kk; k++) {
+						acc aik = ELEM(a, i, k);
+						const elem *restrict q = ROW(b, k);
+						for (j = jj; j < jend; j++)
+							r[j] += aik * q[j];
+					}
+				}
+			}
+		}
 	}
 }
-
@@ -4,8 +4,8 @@
  *
  * Courtesy [Buhler 1993].
  * Routines to realize the Strassen recursive matrix multiplication.
- * StrassenMult n by n matrices a and b, putting the result in c, and
- * using the matrix d as scratch space.  The Strassen algorithm is: 
+ * StrassenMult multiplies the m by k matrix a by the k by n matrix b,
+ * putting the result in c.  The Strassen algorithm is: 
  *
  *      q7 = (a12-a22)(b21+b22)
  *      q6 = (-a11+a21)(b11+b12)
@@ -20,335 +20,587 @@
  *      c22 = q1+q3-q2+q6
  *
  * where the double indices refer to RecSubmatrices in an obvious way.
+ * The identities hold for any 2 by 2 partitioning of conformable
+ * matrices, so rectangular products are split the same way as square
+ * ones, halving m, k and n together.
  * Each line of StrassenMult() that recursively calls itself computes one
  * of the q's.  Four scratch half-size matrices are required by the
  * sequence of computations here; with some rearrangement this
  * storage requirement can be reduced to three half-size matrices. 
  *
- * The small matrix computations (i.e., for n <= block) can be
- * optimized considerably from those given here; in particular, this
- * is important to do before the value of block is chosen optimally. 
+ * The temporaries t1..t10 and q1..q7 of every level come from a
+ * scratch arena allocated once by main(), StrassenSpace() elements
+ * large.  Each call takes its 17 half-size matrices from the top of
+ * the arena and gives them back on return, so the calls at one depth
+ * all reuse the same slice and peak memory is known up front.
+ *
+ * Once the smallest of m, k, n is <= block the product is done by the
+ * packed, vectorized leaf kernel of mm_kernel.c, which also takes care
+ * of the remaining skew of tall-skinny and short-wide shapes.
+ *
+ * The hybrid engine (-a hybrid) stops much earlier, at a crossover
+ * given instead of block or found by HybridCrossover(), and does the
+ * products below it with the cache-blocked, multithreaded PackedMult().
+ * Strassen saves an eighth of the multiplications per level but adds
+ * 18 additions, which only pays off for products large enough that
+ * the classical kernel runs at full speed; on current machines that is
+ * in the thousands, far above the best leaf size.
+ *
+ * Without a block size on the command line the program takes the one
+ * from the tuning file of mm_tune.c, the crossover of the hybrid engine
+ * and the thread count of the parallel one as well; -T tunes them anew.
+ *
+ * Any sizes are accepted: whenever one of m, k, n is odd, the last row
+ * or column concerned is peeled off and handled by PeelMult(), and the
+ * recursion continues on the even part.  The *Space() functions follow
+ * the same sequence of sizes.
  *
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <sys/time.h>
+#include <omp.h>
 #include "mm_strassen.h"
-
-matrix newmatrix(int);		/* allocate storage */
-void freematrix (matrix m, int n); /*free storage */
-void randomfill(int, matrix);	/* fill with random values in the the range [0,1) */
-void auxrandomfill(int, matrix, int, int);
-void print (int, matrix, FILE *); /*print matrix in file*/
-void auxprint(int, matrix, FILE *, int, int );
-void check(int, char *);	/* check for error conditions */
+#include "mm_gemm.h"
+#include "mm_tune.h"
+#include "mm_file.h"
+#include "mm_verify.h"
 
 int block;
+leafmult classical = LeafMult;
+
+/* smallest and largest crossover the search tries, on products of twice that */
+#define CROSSMIN 256
+#define CROSSMAX 1024
+
+static blocking bl;		/* blocking of the hybrid engine */
+
+/* algorithms selectable with -a */
+enum { SERIAL, PARALLEL, LOWMEM, WINOGRAD, HYBRID, NALGOS };
+static char *algos[NALGOS] = { "serial", "parallel", "lowmem", "winograd", "hybrid" };
+
+/* operands of the program, and the algorithm, for trial() */
+static matrix a, b, c;
+static int algo = SERIAL, pardepth = 2;
+
+/* classical products of the hybrid engine */
+static void packedleaf(matrix a, matrix b, matrix c)
+{
+	PackedMult(a, b, c, bl);
+}
+
+/* scratch space the algorithm needs for c = a*b with the current block */
+static size_t scratch(void)
+{
+	if (algo == LOWMEM)
+		return LowMemStrassenSpace(c.rows, a.cols, c.cols);
+	if (algo == WINOGRAD)
+		return WinogradSpace(c.rows, a.cols, c.cols);
+	return StrassenSpace(c.rows, a.cols, c.cols, pardepth);
+}
+
+/* c = a*b with the algorithm selected */
+static void multiply(arena *ws)
+{
+	switch (algo) {
+	case PARALLEL:
+		ParStrassenMult(a, b, c, ws, pardepth);	/* task-parallel strassen */
+		break;
+	case LOWMEM:
+		LowMemStrassenMult( a, b, c, ws);	/* three temporaries per level */
+		break;
+	case WINOGRAD:
+		WinogradMult( a, b, c, ws);	/* 15 additions per level */
+		break;
+	case HYBRID:			/* strassen above the crossover */
+	default:
+		StrassenMult( a, b, c, ws);	/* strassen algorithm */
+	}
+}
+
+/*
+ * time the leading m by k by n part of c = a*b with block size blk
+ * and threads threads, for Tune()
+ */
+static double trial(int blk, int threads, int m, int k, int n)
+{
+	matrix sa = a, sb = b, sc = c;
+	arena ws;
+	double t;
+
+	block = blk;
+	if (algo == PARALLEL)
+		ParInit(threads);
+	a = submatrix(sa, 0, 0, m, k);
+	b = submatrix(sb, 0, 0, k, n);
+	c = submatrix(sc, 0, 0, m, n);
+	ws = newarena(scratch());
+	t = seconds();
+	multiply(&ws);
+	t = seconds() - t;
+	freearena(ws);
+	a = sa;
+	b = sb;
+	c = sc;
+	return t;
+}
 
 int main(int argc, char **argv) {
 	struct timeval ts,tf;
 	double tt;
-	int n;
-	matrix a, b,c;
-	check(argc >= 3, "main: Need matrix size and block size on command line");
-	n = atoi(argv[1]);
-	block=atoi(argv[2]);
-
-	a = newmatrix(n);
-	b = newmatrix(n);
-	c = newmatrix(n);
-
-	randomfill(n, a);
-	randomfill(n, b);
+	int m, k, n, opt, nthreads = 0, retune = 0, tuned = 0, verify = 0, ok = 1;
+	char size[40], engine[64], *afile = NULL, *bfile = NULL;
+	arena ws;
+	tuning t;
+
+	while ((opt = getopt(argc, argv, "a:d:t:A:B:Tv")) != -1) {
+		switch (opt) {
+		case 'a':
+			for (algo = 0; algo < NALGOS; algo++)
+				if (!strcmp(optarg, algos[algo]))
+					break;
+			check(algo < NALGOS, "main: Unknown algorithm");
+			break;
+		case 'd':
+			pardepth = atoi(optarg);
+			break;
+		case 't':
+			nthreads = atoi(optarg);
+			break;
+		case 'A':
+			afile = optarg;
+			break;
+		case 'B':
+			bfile = optarg;
+			break;
+		case 'v':
+			verify = 1;
+			break;
+		case 'T':
+			retune = 1;
+			break;
+		default:
+			check(0, "main: usage: strassen [-a serial|parallel|lowmem|winograd|hybrid] [-d depth] [-t threads] [-T] [-v] {size | -A file -B file} [block]");
+		}
+	}
+	if (afile != NULL || bfile != NULL)
+		readoperands(afile, bfile, &a, &b);	/* size of the files */
+	else {
+		check(argc - optind >= 1, "main: Need matrix size on command line");
+		parsesize(argv[optind++], &m, &k, &n);
+		a = newmatrix(m, k);
+		b = newmatrix(k, n);
+		randomfill(a, SEEDA);
+		randomfill(b, SEEDB);
+	}
+	m = a.rows;
+	k = a.cols;
+	n = b.cols;
+	sizename(size, m, k, n);
+	block = argc - optind >= 1 ? atoi(argv[optind]) : 0;
+	c = newmatrix(m, n);
+
+	if (algo == HYBRID) {
+		bl = CacheBlocking();
+		classical = packedleaf;
+	}
+	if (algo == PARALLEL)
+		ParInit(nthreads);
+	else
+		pardepth = 0;
+
+	/*
+	 * Without a block size use the tuned one, tuning first if need be.
+	 * The crossover of the hybrid engine is found by HybridCrossover()
+	 * with the OpenMP threads of its classical products.  -t, or
+	 * OMP_NUM_THREADS for the hybrid engine, wins over the tuned
+	 * thread count.
+	 */
+	if (block <= 0) {
+		sprintf(engine, "strassen" ELEMSUFFIX "-%s", algos[algo]);
+		if (retune || !LoadTuning(engine, m, k, n, &t)) {
+			if (algo == HYBRID) {
+				t.block = HybridCrossover(m, k, n);
+				t.threads = omp_get_max_threads();
+			}
+			else
+				t = Tune(trial, m, k, n, algo == PARALLEL ? ParThreads() : 1);
+			SaveTuning(engine, m, k, n, t);
+		}
+		block = t.block;
+		if (algo == PARALLEL)
+			ParInit(nthreads > 0 ? nthreads : t.threads);
+		if (algo == HYBRID && getenv("OMP_NUM_THREADS") == NULL)
+			omp_set_num_threads(t.threads);
+		tuned = 1;
+	}
+
+	ws = newarena(scratch());
 	gettimeofday(&ts,NULL);
-	StrassenMult(n, a, b, c);	/* strassen algorithm */
+	multiply(&ws);
 	gettimeofday(&tf,NULL);
 	tt=(tf.tv_sec-ts.tv_sec)+(tf.tv_usec-ts.tv_usec)*0.000001;
-	printf("Strassen Size %d Block %d Time %lf\n",n,block,tt);
-	char *filename=malloc(30*sizeof(char));
-	sprintf(filename,"res_mm_strassen_%d",n);
-	FILE * f=fopen(filename,"w");
-	print(n,c,f);
-	fclose(f);
-
-	freematrix(a,n);
-	freematrix(b,n);
-	freematrix(c,n);	
-    	return 0;
+	switch (algo) {
+	case PARALLEL:
+		printf("Parallel Strassen Size %s Block %d Depth %d Threads %d Time %lf\n",
+			size,block,pardepth,ParThreads(),tt);
+		break;
+	case LOWMEM:
+		printf("Low-memory Strassen Size %s Block %d Scratch %zu Time %lf\n",
+			size,block,ws.size,tt);
+		break;
+	case WINOGRAD:
+		printf("Winograd Size %s Block %d Time %lf\n",size,block,tt);
+		break;
+	case HYBRID:
+		printf("Hybrid Strassen Size %s Crossover %d %s Threads %d Time %lf\n",
+			size,block,tuned ? "Tuned" : "Fixed",omp_get_max_threads(),tt);
+		break;
+	default:
+		printf("Strassen Size %s Block %d Time %lf\n",size,block,tt);
+	}
+	writeresult(c,"strassen",size);
+	if (verify)
+		ok = VerifyStrassen(a, b, c, StrassenLevels(m, k, n));
+
+	freeoperand(a);
+	freeoperand(b);
+	freematrix(c);
+	freearena(ws);
+    	return ok ? 0 : 1;
+}
+
+/*
+ * Scratch space in elements needed to multiply an m by k by a k by n
+ * matrix, when the top pardepth levels run their seven products
+ * concurrently and so need seven private arenas instead of one shared.
+ * Five of the t's are shaped like quadrants of a, five like quadrants
+ * of b, and the seven q's like quadrants of c.
+ */
+size_t StrassenSpace(int m, int k, int n, int pardepth) {
+	size_t s;
+
+	if (LEAF(m, k, n))
+		return 0;
+	if (ODD(m, k, n))
+		return StrassenSpace(EVEN(m), EVEN(k), EVEN(n), pardepth);
+	m /= 2;
+	k /= 2;
+	n /= 2;
+	s = 5 * matrixspace(m, k) + 5 * matrixspace(k, n) + 7 * matrixspace(m, n);
+	return s + (pardepth > 0 ? 7 : 1) * StrassenSpace(m, k, n, pardepth - 1);
+}
+
+/* levels of recursion above the classical products, for all the engines */
+int StrassenLevels(int m, int k, int n) {
+	if (LEAF(m, k, n))
+		return 0;
+	return 1 + StrassenLevels(EVEN(m) / 2, EVEN(k) / 2, EVEN(n) / 2);
 }
 
 /*Recursive Strassen Multiplication*/
-void StrassenMult(int n, matrix a, matrix b, matrix c) {
+void StrassenMult(matrix a, matrix b, matrix c, arena *ws) {
 	
 	matrix t1,t2,t3,t4,t5,t6,t7,t8,t9,t10,q1,q2,q3,q4,q5,q6,q7;
+	size_t mark = ws->top;
+	int m = c.rows / 2, k = a.cols / 2, n = c.cols / 2;
 
 	
-    	if (n <= block) {
-		double sum, **p = a->d, **q = b->d, **r = c->d;
-		int i, j, k;
-
-		for (i = 0; i < n; i++) {
-			for (j = 0; j < n; j++) {
-				for (sum = 0., k = 0; k < n; k++)
-					sum += p[i][k] * q[k][j];
-				r[i][j] = sum;
-	    		}
-		}
-    	} 
+    	if (LEAF(c.rows, a.cols, c.cols))
+		classical(a, b, c);
+	else if (ODD(c.rows, a.cols, c.cols)) {
+		StrassenMult(PEEL(a), PEEL(b), PEEL(c), ws);
+		PeelMult(a, b, c);
+	}
 	else {
-		n /= 2;
-
-
-		t1=newmatrix(n);
-		t2=newmatrix(n);
-		t3=newmatrix(n);
-		t4=newmatrix(n);
-		t5=newmatrix(n);
-		t6=newmatrix(n);
-		t7=newmatrix(n);
-		t8=newmatrix(n);
-		t9=newmatrix(n);
-		t10=newmatrix(n);
-		q1=newmatrix(n);
-		q2=newmatrix(n);
-		q3=newmatrix(n);
-		q4=newmatrix(n);
-		q5=newmatrix(n);
-		q6=newmatrix(n);
-		q7=newmatrix(n);
-
-		RecAdd(n,a11,a22,t1);
-		RecAdd(n,b11,b22,t2);		
-		RecAdd(n,a21,a22,t3);
-		RecSub(n,b12,b22,t4);		
-		RecSub(n,b21,b11,t5);		
-		RecAdd(n,a11,a12,t6);		
-		RecSub(n,a21,a11,t7);		
-		RecAdd(n,b11,b12,t8);		
-		RecSub(n,a12,a22,t9);		
-		RecAdd(n,b21,b22,t10);
+		t1=scratchmatrix(ws, m, k);
+		t2=scratchmatrix(ws, k, n);
+		t3=scratchmatrix(ws, m, k);
+		t4=scratchmatrix(ws, k, n);
+		t5=scratchmatrix(ws, k, n);
+		t6=scratchmatrix(ws, m, k);
+		t7=scratchmatrix(ws, m, k);
+		t8=scratchmatrix(ws, k, n);
+		t9=scratchmatrix(ws, m, k);
+		t10=scratchmatrix(ws, k, n);
+		q1=scratchmatrix(ws, m, n);
+		q2=scratchmatrix(ws, m, n);
+		q3=scratchmatrix(ws, m, n);
+		q4=scratchmatrix(ws, m, n);
+		q5=scratchmatrix(ws, m, n);
+		q6=scratchmatrix(ws, m, n);
+		q7=scratchmatrix(ws, m, n);
+
+		RecAdd(a11,a22,t1);
+		RecAdd(b11,b22,t2);		
+		RecAdd(a21,a22,t3);
+		RecSub(b12,b22,t4);		
+		RecSub(b21,b11,t5);		
+		RecAdd(a11,a12,t6);		
+		RecSub(a21,a11,t7);		
+		RecAdd(b11,b12,t8);		
+		RecSub(a12,a22,t9);		
+		RecAdd(b21,b22,t10);
 				
-		StrassenMult(n,t1,t2,q1);		
-		StrassenMult(n,t3,b11,q2);		
-		StrassenMult(n,a11,t4,q3);		
-		StrassenMult(n,a22,t5,q4);		
-		StrassenMult(n,t6,b22,q5);		
-		StrassenMult(n,t7,t8,q6);		
-		StrassenMult(n,t9,t10,q7);
+		StrassenMult(t1,t2,q1,ws);		
+		StrassenMult(t3,b11,q2,ws);		
+		StrassenMult(a11,t4,q3,ws);		
+		StrassenMult(a22,t5,q4,ws);		
+		StrassenMult(t6,b22,q5,ws);		
+		StrassenMult(t7,t8,q6,ws);		
+		StrassenMult(t9,t10,q7,ws);
 		
-		RecAdd(n,q1,q4,c11);
-		RecSub(n,c11,q5,c11);
-		RecAdd(n,q7,c11,c11);
+		RecAdd(q1,q4,c11);
+		RecSub(c11,q5,c11);
+		RecAdd(q7,c11,c11);
 			
-		RecAdd(n,q3,q5,c12);
+		RecAdd(q3,q5,c12);
 		
-		RecAdd(n,q2,q4,c21);
+		RecAdd(q2,q4,c21);
 		
-		RecAdd(n,q1,q3,c22);
-		RecAdd(n,q6,c22,c22);
-		RecSub(n,c22,q2,c22);
+		RecAdd(q1,q3,c22);
+		RecAdd(q6,c22,c22);
+		RecSub(c22,q2,c22);
 		
-		freematrix(t1,n);
-		freematrix(t2,n);
-		freematrix(t3,n);
-		freematrix(t4,n);
-		freematrix(t5,n);
-		freematrix(t6,n);
-		freematrix(t7,n);
-		freematrix(t8,n);
-		freematrix(t9,n);
-		freematrix(t10,n);
-		freematrix(q1,n);
-		freematrix(q2,n);
-		freematrix(q3,n);
-		freematrix(q4,n);
-		freematrix(q5,n);
-		freematrix(q6,n);
-		freematrix(q7,n);
+		ws->top = mark;
 
 	}
 }
 
 
-/* c = a+b */
-void RecAdd(int n, matrix a, matrix b, matrix c) {
-    	if (n <= block) {
-		double **p = a->d, **q = b->d, **r = c->d;
-		int i, j;
-
-		for (i = 0; i < n; i++) 
-		    	for (j = 0; j < n; j++) 
-				r[i][j] = p[i][j] + q[i][j];
-
-    	}	 
-	else {
-		n /= 2;
-		RecAdd(n, a11, b11, c11);        
-		RecAdd(n, a12, b12, c12);			        
-		RecAdd(n, a21, b21,c21);		
-		RecAdd(n, a22, b22, c22);
-    	}
-}
-
-/* c = a-b */
-void RecSub(int n, matrix a, matrix b, matrix c) {
-    	if (n <= block) {
-		double **p = a->d, **q = b->d, **r = c->d;
-		int i, j;
-
-		for (i = 0; i < n; i++) 
-		    	for (j = 0; j < n; j++) 
-				r[i][j] = p[i][j] - q[i][j];
-	    
-    	} 	
-	else {
-		n /= 2;		
-		RecSub(n, a11, b11, c11);		
-		RecSub(n, a12, b12, c12);			
-   		RecSub(n, a21, b21, c21);    	
-		RecSub(n, a22, b22, c22);		
-    	}
-}
-
-/* Recursive randomfill -- possibly useful for NUMA archs*/
-/* Fill the matrix a with random values between 0 and 1 */
 /*
-void randomfill(int n, matrix a) {
-    if (n <= block) {
-		int i, j;
-		double **p = a->d, T = -(double)(1 << 31);
-
-		for (i = 0; i < n; i++)
-			for (j = 0; j < n; j++)
-				p[i][j] = random() / T;
-	} 
-	else {
-		n /= 2;
-		randomfill(n, a11);
-		randomfill(n, a12);
-		randomfill(n, a21);
-		randomfill(n, a22);
-	}
-}
-*/
-
-
-
-/* fill n by n matrix with random numbers */
-void randomfill(int n, matrix a) {
-	int i,j;
-	double T = -(double)(1 << 31);
-
-    	if (n <= block) {
-		for (i = 0; i < n; i++)
-	    		for (j = 0; j < n; j++)
-				a->d[i][j] = rand() / T;
-    	} 		
-	else {
-		for (i=0;i<n;i++)
-			for (j=0;j<n;j++) 
-				auxrandomfill(n,a,i,j);
-    	}
-}
-
-void auxrandomfill(int n, matrix a, int i, int j) {
-
-	double T = -(double)(1 << 31);
-	if (n<=block) 
-		a->d[i][j]=rand()/T;
-	else 
-		auxrandomfill(n/2,a->p[(i>=n/2)*2+(j>=n/2)],i%(n/2),j%(n/2));
+ * Scratch space in elements needed by LowMemStrassenMult: one quadrant
+ * each of a, b and c per level, i.e. less than n*n in total for square
+ * matrices against 17/3 n*n for StrassenMult.
+ */
+size_t LowMemStrassenSpace(int m, int k, int n) {
+	if (LEAF(m, k, n))
+		return 0;
+	if (ODD(m, k, n))
+		return LowMemStrassenSpace(EVEN(m), EVEN(k), EVEN(n));
+	m /= 2;
+	k /= 2;
+	n /= 2;
+	return matrixspace(m, k) + matrixspace(k, n) + matrixspace(m, n)
+		+ LowMemStrassenSpace(m, k, n);
 }
 
+/*
+ * Strassen with the storage reduced to three half-size temporaries per
+ * level: t holds the sums of quadrants of a, u the sums of quadrants of
+ * b and q a product that has to be added into several quadrants of c.
+ * Products are computed straight into a quadrant of c whenever that
+ * quadrant is written for the first time:
+ *
+ *      c21 = (a21+a22)b11                      c21 = q2
+ *      c11 = a22(-b11+b21)                     c11 = q4
+ *      c12 = a11(b12-b22)                      c12 = q3
+ *      c22 = c12-c21, c21 = c21+c11            c22 = q3-q2, c21 = q2+q4
+ *      q = (a11+a12)b22, c12 += q, c11 -= q    q = q5
+ *      q = (a11+a22)(b11+b22), c11 += q, c22 += q      q = q1
+ *      q = (-a11+a21)(b11+b12), c22 += q       q = q6
+ *      q = (a12-a22)(b21+b22), c11 += q        q = q7
+ *
+ * which takes the same 18 additions as StrassenMult.
+ */
+void LowMemStrassenMult(matrix a, matrix b, matrix c, arena *ws) {
+	matrix t, u, q;
+	size_t mark = ws->top;
 
-/* return new square n by n matrix */
-matrix newmatrix(int n) {
-
-    	matrix a;
-    	a = (matrix)malloc(sizeof(*a));
-    	check(a != NULL, "newmatrix: out of space for matrix");
-    	if (n <= block) {
-		int i;
-		a->d = (double **)calloc(n, sizeof(double *));
-		check(a->d != NULL,
-			"newmatrix: out of space for row pointers");
-		for (i = 0; i < n; i++) {
-	    	a->d[i] = (double *)calloc(n, sizeof(double));
-	    	check(a != NULL, "newmatrix: out of space for rows");
-		}
-    	} 
-	else {
-		n /= 2;
-		a->p = (matrix *)calloc(4, sizeof(matrix));
-		check(a->p != NULL,
-			"newmatrix: out of space for RecSubmatrices");
-		a11 = newmatrix(n);
-		a12 = newmatrix(n);
-		a21 = newmatrix(n);
-		a22 = newmatrix(n);
-    	}
-    	return a;
-}
-
-/* free square n by n matrix m */
-void freematrix (matrix m, int n) {
-	if (n<=block) {
-		int i;
-		for (i=0;i<n;i++)
-			free(m->d[i]);
-		free(m->d);
+	if (LEAF(c.rows, a.cols, c.cols)) {
+		classical(a, b, c);
+		return;
 	}
-	else {
-		n/=2;	
-		freematrix(m->p[0],n);
-		freematrix(m->p[1],n);
-		freematrix(m->p[2],n);
-		freematrix(m->p[3],n);
+	if (ODD(c.rows, a.cols, c.cols)) {
+		LowMemStrassenMult(PEEL(a), PEEL(b), PEEL(c), ws);
+		PeelMult(a, b, c);
+		return;
 	}
+	t = scratchmatrix(ws, c.rows / 2, a.cols / 2);
+	u = scratchmatrix(ws, a.cols / 2, c.cols / 2);
+	q = scratchmatrix(ws, c.rows / 2, c.cols / 2);
+
+	RecAdd(a21,a22,t);
+	LowMemStrassenMult(t,b11,c21,ws);
+	RecSub(b21,b11,u);
+	LowMemStrassenMult(a22,u,c11,ws);
+	RecSub(b12,b22,u);
+	LowMemStrassenMult(a11,u,c12,ws);
+	RecSub(c12,c21,c22);
+	RecAdd(c21,c11,c21);
+
+	RecAdd(a11,a12,t);
+	LowMemStrassenMult(t,b22,q,ws);
+	RecAdd(c12,q,c12);
+	RecSub(c11,q,c11);
+
+	RecAdd(a11,a22,t);
+	RecAdd(b11,b22,u);
+	LowMemStrassenMult(t,u,q,ws);
+	RecAdd(c11,q,c11);
+	RecAdd(c22,q,c22);
+
+	RecSub(a21,a11,t);
+	RecAdd(b11,b12,u);
+	LowMemStrassenMult(t,u,q,ws);
+	RecAdd(c22,q,c22);
+
+	RecSub(a12,a22,t);
+	RecAdd(b21,b22,u);
+	LowMemStrassenMult(t,u,q,ws);
+	RecAdd(c11,q,c11);
+
+	ws->top = mark;
 }
 
-/* print n by n matrix into file f*/
-void print(int n, matrix a, FILE * f) {
-	int i,j;
-	
-    	if (n <= block) {
-		for (i = 0; i < n; i++) {
-	    		for (j = 0; j < n; j++)
-				fprintf(f,"%lf ",a->d[i][j]);
-			fprintf(f,"\n");	
-		}
-    	} 		
-	else {
-		for (i=0;i<n;i++) {
-			for (j=0;j<n;j++) 
-				auxprint(n,a,f,i,j);
-			fprintf(f,"\n");
-		}
-    	}
+/*
+ * Scratch space in elements needed by WinogradMult: x has to hold a
+ * quadrant of a and later one of c, y a quadrant of b.
+ */
+size_t WinogradSpace(int m, int k, int n) {
+	if (LEAF(m, k, n))
+		return 0;
+	if (ODD(m, k, n))
+		return WinogradSpace(EVEN(m), EVEN(k), EVEN(n));
+	m /= 2;
+	k /= 2;
+	n /= 2;
+	return matrixspace(m, k > n ? k : n) + matrixspace(k, n)
+		+ WinogradSpace(m, k, n);
 }
 
-void auxprint(int n, matrix a, FILE * f, int i, int j) {
-
-	if (n<=block) 
-		fprintf(f,"%lf ",a->d[i][j]);
-	else 
-		auxprint(n/2,a->p[(i>=n/2)*2+(j>=n/2)],f,i%(n/2),j%(n/2));
+/*
+ * Winograd's variant of Strassen's algorithm, which needs 15 instead
+ * of 18 additions per level:
+ *
+ *      s1 = a21+a22    s2 = s1-a11     s3 = a11-a21    s4 = a12-s2
+ *      t1 = b12-b11    t2 = b22-t1     t3 = b22-b12    t4 = t2-b21
+ *      p1 = a11b11     p2 = a12b21     p3 = s4b22      p4 = a22t4
+ *      p5 = s1t1       p6 = s2t2       p7 = s3t3
+ *      u2 = p1+p6      u3 = u2+p7      u4 = u2+p5
+ *      c11 = p1+p2     c12 = u4+p3     c21 = u3-p4     c22 = u3+p5
+ *
+ * Following the schedule of [Douglas et al. 1994] the quadrants of c
+ * double as temporaries, so that only two half-size scratch matrices
+ * x and y per level are needed.  x holds sums of quadrants of a first
+ * and p1, shaped like a quadrant of c, in the end; xc is the latter
+ * view of the same storage.  The leaves use the same leaf kernel
+ * as StrassenMult().
+ */
+void WinogradMult(matrix a, matrix b, matrix c, arena *ws) {
+	matrix x, xc, y;
+	size_t mark = ws->top;
+	int m = c.rows / 2, k = a.cols / 2, n = c.cols / 2;
+
+	if (LEAF(c.rows, a.cols, c.cols)) {
+		classical(a, b, c);
+		return;
+	}
+	if (ODD(c.rows, a.cols, c.cols)) {
+		WinogradMult(PEEL(a), PEEL(b), PEEL(c), ws);
+		PeelMult(a, b, c);
+		return;
+	}
+	x = scratchmatrix(ws, m, k > n ? k : n);
+	xc = submatrix(x, 0, 0, m, n);
+	x = submatrix(x, 0, 0, m, k);
+	y = scratchmatrix(ws, k, n);
+
+	RecSub(a11,a21,x);		/* s3 */
+	RecSub(b22,b12,y);		/* t3 */
+	WinogradMult(x,y,c21,ws);	/* p7 */
+	RecAdd(a21,a22,x);		/* s1 */
+	RecSub(b12,b11,y);		/* t1 */
+	WinogradMult(x,y,c22,ws);	/* p5 */
+	RecSub(x,a11,x);		/* s2 */
+	RecSub(b22,y,y);		/* t2 */
+	WinogradMult(x,y,c12,ws);	/* p6 */
+	RecSub(a12,x,x);		/* s4 */
+	WinogradMult(x,b22,c11,ws);	/* p3 */
+	WinogradMult(a11,b11,xc,ws);	/* p1 */
+	RecAdd(xc,c12,c12);		/* u2 */
+	RecAdd(c12,c21,c21);		/* u3 */
+	RecAdd(c12,c22,c12);		/* u4 */
+	RecAdd(c21,c22,c22);		/* c22 = u3+p5 */
+	RecAdd(c12,c11,c12);		/* c12 = u4+p3 */
+	RecSub(y,b21,y);		/* t4 */
+	WinogradMult(a22,y,c11,ws);	/* p4 */
+	RecSub(c21,c11,c21);		/* c21 = u3-p4 */
+	WinogradMult(a12,b21,c11,ws);	/* p2 */
+	RecAdd(xc,c11,c11);		/* c11 = p1+p2 */
+
+	ws->top = mark;
 }
 
 /*
- * If the expression e is false print the error message s and quit. 
+ * Crossover of the hybrid engine for an m by k by n product: the size
+ * s/2 for the smallest power of two s >= 2*CROSSMIN at which one level
+ * of Strassen over the classical products beats the classical product
+ * alone, timed on s by s matrices at best of two runs.  Strassen is
+ * assumed to win for all larger sizes too.  The search stops at
+ * 2*CROSSMAX, so that it costs the same for every large product; if
+ * Strassen never wins up to there or the smallest of m, k, n, the
+ * whole product is done classically.  block is left set to the result.
  */
-
-
-void check(int e, char *s)
+int HybridCrossover(int m, int k, int n)
 {
-    	if (!e) {
-		fprintf(stderr, "Fatal error -> %s\n", s);
-		exit(1);
-    	}
+	int i, s, max = m < k ? (m < n ? m : n) : (k < n ? k : n);
+	double t, tclassical, tstrassen;
+	matrix a, b, c;
+	arena ws;
+
+	for (s = 2 * CROSSMIN; s <= max && s <= 2 * CROSSMAX; s *= 2) {
+		a = newmatrix(s, s);
+		b = newmatrix(s, s);
+		c = newmatrix(s, s);
+		randomfill(a, SEEDA);
+		randomfill(b, SEEDB);
+		block = s / 2;
+		ws = newarena(StrassenSpace(s, s, s, 0));
+
+		tclassical = tstrassen = 1e30;
+		for (i = 0; i < 2; i++) {
+			t = seconds();
+			classical(a, b, c);
+			t = seconds() - t;
+			tclassical = t < tclassical ? t : tclassical;
+			t = seconds();
+			StrassenMult(a, b, c, &ws);
+			t = seconds() - t;
+			tstrassen = t < tstrassen ? t : tstrassen;
+		}
+
+		freematrix(a);
+		freematrix(b);
+		freematrix(c);
+		freearena(ws);
+		if (tstrassen < tclassical)
+			return block;
+	}
+	return block = max;
 }
 
+/* c = a+b */
+void RecAdd(matrix a, matrix b, matrix c) {
+	int i, j;
 
+	for (i = 0; i < c.rows; i++) {
+		elem *p = ROW(a, i), *q = ROW(b, i), *r = ROW(c, i);
+	    	for (j = 0; j < c.cols; j++) 
+			r[j] = p[j] + q[j];
+	}
+}
 
+/* c = a-b */
+void RecSub(matrix a, matrix b, matrix c) {
+	int i, j;
 
+	for (i = 0; i < c.rows; i++) {
+		elem *p = ROW(a, i), *q = ROW(b, i), *r = ROW(c, i);
+	    	for (j = 0; j < c.cols; j++) 
+			r[j] = p[j] - q[j];
+	}
+}
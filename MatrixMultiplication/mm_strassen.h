@@ -6,49 +6,72 @@
  */
 
 /*
- * Square matrices of size <= block are handled with the ``classical
- * algorithms.  The shape of almost all functions is therefore
- * something like
+ * Products with one of m, k, n <= block are handled with the
+ * ``classical'' algorithms, i.e. the leaf kernel of mm_kernel.h.  The
+ * shape of almost all functions is therefore something like
  *
- *	if ( n <= block )
+ *	if ( LEAF(m, k, n) )
  *	    classical algorithms
  *	else
- *	    n/= 2
+ *	    m/= 2, k/= 2, n/= 2
  *	    recursive call for 4 half-size submatrices
  */
 
-typedef union _matrix {
-    double **d;
-    union _matrix **p;
-} *matrix;
+#include "mm_matrix.h"
+#include "mm_kernel.h"
 
+extern int block;
+extern leafmult classical;	/* product once LEAF() holds, LeafMult() */
 
-void StrassenMult(int,matrix,matrix,matrix);
-void RecAdd(int, matrix, matrix, matrix);
-void RecSub(int, matrix, matrix, matrix);
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void StrassenMult(matrix,matrix,matrix,arena *);
+size_t StrassenSpace(int, int, int, int);	/* scratch for m, k, n, parallel depth */
+void LowMemStrassenMult(matrix,matrix,matrix,arena *);
+size_t LowMemStrassenSpace(int, int, int);	/* scratch elements for m, k, n */
+void WinogradMult(matrix,matrix,matrix,arena *);
+size_t WinogradSpace(int, int, int);	/* scratch elements for m, k, n */
+int HybridCrossover(int, int, int);	/* tuned block of the hybrid engine */
+int StrassenLevels(int, int, int);	/* levels of recursion for m, k, n */
+void RecAdd(matrix, matrix, matrix);
+void RecSub(matrix, matrix, matrix);
+
+/* task-parallel version, mm_strassen_tbb.cpp */
+void ParStrassenMult(matrix, matrix, matrix, arena *, int);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* stop the recursion, or peel before splitting, for an m by k by n product */
+#define LEAF(m, k, n) ((m) <= block || (k) <= block || (n) <= block)
+#define ODD(m, k, n) (((m) | (k) | (n)) & 1)
+#define EVEN(n) ((n) & ~1)
 
 /*
- * Notational shorthand to access submatrices for matrices named
+ * Notational shorthand to access the quadrant views of matrices named
  * a,b,c,d 
  */
 
-#define a11 a->p[0]
-#define a12 a->p[1]
-#define a21 a->p[2]
-#define a22 a->p[3]
-#define b11 b->p[0]
-#define b12 b->p[1]
-#define b21 b->p[2]
-#define b22 b->p[3]
-#define c11 c->p[0]
-#define c12 c->p[1]
-#define c21 c->p[2]
-#define c22 c->p[3]
-#define d11 d->p[0]
-#define d12 d->p[1]
-#define d21 d->p[2]
-#define d22 d->p[3]
-#define e11 e->p[0]
-#define e12 e->p[1]
-#define e21 e->p[2]
-#define e22 e->p[3]
+#define a11 quadrant(a, 0)
+#define a12 quadrant(a, 1)
+#define a21 quadrant(a, 2)
+#define a22 quadrant(a, 3)
+#define b11 quadrant(b, 0)
+#define b12 quadrant(b, 1)
+#define b21 quadrant(b, 2)
+#define b22 quadrant(b, 3)
+#define c11 quadrant(c, 0)
+#define c12 quadrant(c, 1)
+#define c21 quadrant(c, 2)
+#define c22 quadrant(c, 3)
+#define d11 quadrant(d, 0)
+#define d12 quadrant(d, 1)
+#define d21 quadrant(d, 2)
+#define d22 quadrant(d, 3)
+#define e11 quadrant(e, 0)
+#define e12 quadrant(e, 1)
+#define e21 quadrant(e, 2)
+#define e22 quadrant(e, 3)
@@ -0,0 +1,101 @@
+/*
+ * mm_strassen_tbb.cpp
+ *
+ * Task-parallel Strassen multiplication on top of the TBB
+ * work-stealing scheduler.  Every level runs in three phases:
+ *
+ *	t1..t10	the ten pre-additions, all independent, one task each
+ *	q1..q7	the seven recursive products, one task each
+ *	c11..c22	the post-additions, one task per quadrant of c
+ *
+ * Spawning stops pardepth levels below the top, where the serial
+ * StrassenMult() takes over.  With seven products per level the task
+ * tree grows as 7^pardepth, so a small depth already keeps all cores
+ * busy.
+ *
+ * The seven products of a level run at the same time, so each of them
+ * gets a private arena of StrassenSpace() elements carved out of the
+ * parent's, right above the parent's own 17 temporaries.
+ */
+
+#include <tbb/task_group.h>
+#include "mm_strassen.h"
+
+/* c = a*b, spawning tasks for the top pardepth levels */
+void ParStrassenMult(matrix a, matrix b, matrix c, arena *ws, int pardepth)
+{
+	matrix t1,t2,t3,t4,t5,t6,t7,t8,t9,t10,q1,q2,q3,q4,q5,q6,q7;
+	arena sub[7], *s = sub;
+	size_t mark = ws->top, space;
+	tbb::task_group g;
+	int i, m = c.rows / 2, k = a.cols / 2, n = c.cols / 2;
+
+	if (LEAF(c.rows, a.cols, c.cols) || pardepth <= 0) {
+		StrassenMult(a, b, c, ws);
+		return;
+	}
+
+	if (ODD(c.rows, a.cols, c.cols)) {
+		ParStrassenMult(PEEL(a), PEEL(b), PEEL(c), ws, pardepth);
+		PeelMult(a, b, c);
+		return;
+	}
+
+	pardepth--;
+
+	t1=scratchmatrix(ws, m, k);
+	t2=scratchmatrix(ws, k, n);
+	t3=scratchmatrix(ws, m, k);
+	t4=scratchmatrix(ws, k, n);
+	t5=scratchmatrix(ws, k, n);
+	t6=scratchmatrix(ws, m, k);
+	t7=scratchmatrix(ws, m, k);
+	t8=scratchmatrix(ws, k, n);
+	t9=scratchmatrix(ws, m, k);
+	t10=scratchmatrix(ws, k, n);
+	q1=scratchmatrix(ws, m, n);
+	q2=scratchmatrix(ws, m, n);
+	q3=scratchmatrix(ws, m, n);
+	q4=scratchmatrix(ws, m, n);
+	q5=scratchmatrix(ws, m, n);
+	q6=scratchmatrix(ws, m, n);
+	q7=scratchmatrix(ws, m, n);
+	space = StrassenSpace(m, k, n, pardepth);
+	for (i = 0; i < 7; i++)
+		sub[i] = subarena(ws, space);
+
+	g.run([=] { RecAdd(a11,a22,t1); });
+	g.run([=] { RecAdd(b11,b22,t2); });
+	g.run([=] { RecAdd(a21,a22,t3); });
+	g.run([=] { RecSub(b12,b22,t4); });
+	g.run([=] { RecSub(b21,b11,t5); });
+	g.run([=] { RecAdd(a11,a12,t6); });
+	g.run([=] { RecSub(a21,a11,t7); });
+	g.run([=] { RecAdd(b11,b12,t8); });
+	g.run([=] { RecSub(a12,a22,t9); });
+	RecAdd(b21,b22,t10);
+	g.wait();
+
+	g.run([=] { ParStrassenMult(t1,t2,q1,&s[0],pardepth); });
+	g.run([=] { ParStrassenMult(t3,b11,q2,&s[1],pardepth); });
+	g.run([=] { ParStrassenMult(a11,t4,q3,&s[2],pardepth); });
+	g.run([=] { ParStrassenMult(a22,t5,q4,&s[3],pardepth); });
+	g.run([=] { ParStrassenMult(t6,b22,q5,&s[4],pardepth); });
+	g.run([=] { ParStrassenMult(t7,t8,q6,&s[5],pardepth); });
+	ParStrassenMult(t9,t10,q7,&s[6],pardepth);
+	g.wait();
+
+	g.run([=] {
+		RecAdd(q1,q4,c11);
+		RecSub(c11,q5,c11);
+		RecAdd(q7,c11,c11);
+	});
+	g.run([=] { RecAdd(q3,q5,c12); });
+	g.run([=] { RecAdd(q2,q4,c21); });
+	RecAdd(q1,q3,c22);
+	RecAdd(q6,c22,c22);
+	RecSub(c22,q2,c22);
+	g.wait();
+
+	ws->top = mark;
+}
@@ -0,0 +1,58 @@
+/*
+ * mm_tasks.cpp
+ *
+ * Control of the TBB task scheduler used by the task-parallel engines.
+ * oneTBB limits the scheduler with a global_control; TBB 4.x, such as
+ * the one in tbbs_resources, with a task_scheduler_init instead.
+ */
+
+/* tbb_stddef.h is gone from oneTBB */
+#if defined(__has_include)
+#if !__has_include(<tbb/tbb_stddef.h>)
+#define MM_ONETBB
+#endif
+#else
+#define MM_ONETBB
+#endif
+
+#ifdef MM_ONETBB
+#include <tbb/task_arena.h>
+#include <tbb/global_control.h>
+#else
+#include <tbb/task_scheduler_init.h>
+#endif
+#include "mm_matrix.h"
+
+#ifdef MM_ONETBB
+static tbb::global_control *control;
+#else
+static tbb::task_scheduler_init *control;
+static int threads;
+#endif
+
+/*
+ * limit the scheduler to nthreads threads, 0 means all cores; a later
+ * call replaces the limit, as the tuner does
+ */
+void ParInit(int nthreads)
+{
+	delete control;
+	control = NULL;
+#ifdef MM_ONETBB
+	if (nthreads > 0)
+		control = new tbb::global_control(
+			tbb::global_control::max_allowed_parallelism, nthreads);
+#else
+	threads = nthreads > 0 ? nthreads : tbb::task_scheduler_init::default_num_threads();
+	control = new tbb::task_scheduler_init(threads);
+#endif
+}
+
+int ParThreads(void)
+{
+#ifdef MM_ONETBB
+	return tbb::this_task_arena::max_concurrency();
+#else
+	return threads > 0 ? threads : tbb::task_scheduler_init::default_num_threads();
+#endif
+}
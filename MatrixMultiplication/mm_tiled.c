@@ -4,214 +4,280 @@
  *
  * Routines to realize the tiled matrix multiplication.
  *
- * The small matrix computations (i.e., for n <= block) can be
- * optimized considerably from those given here; in particular, this
- * is important to do before the value of block is chosen optimally. 
+ * The tile products go through the leaf kernels of mm_kernel.c, the
+ * fixed-size ones of mm_fixed.cpp for full tiles of block 8 to 64.  The
+ * first product a(i,0)*b(0,j) overwrites tile c(i,j) and the others
+ * accumulate into it, so c need not be zeroed first.
+ *
+ * Without a block size on the command line the program takes the one
+ * from the tuning file of mm_tune.c, and the thread count as well for
+ * the parallel versions; -T tunes them anew.
+ *
+ * -a numa is the parallel version for NUMA machines: after tuning, a
+ * and c are copied onto the nodes of the threads that compute their
+ * tile rows and b is spread over all nodes, see mm_numa.c, and
+ * NumaTiledMult() has the threads work on the tiles of their own node
+ * first.
  *
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <sys/time.h>
+#include <omp.h>
 #include "mm_tiled.h"
+#include "mm_tune.h"
+#include "mm_file.h"
+#include "mm_verify.h"
+#include "mm_numa.h"
 
 
-matrix newmatrix(int);		/* allocate storage */
-void freematrix (matrix, int); /*free storage */
-void randomfill(int, matrix);	/* fill with random values in the range [0,1) */
-void print (matrix, int, FILE *);
-void check(int, char *);	/* check for error conditions */
 int block;
 
+/* algorithms selectable with -a */
+enum { SERIAL, PARALLEL, NUMA, NALGOS };
+static char *algos[NALGOS] = { "serial", "parallel", "numa" };
+
+/* operands of the program, and the algorithm, for trial() */
+static matrix a, b;
+static accmatrix c;
+static int algo = SERIAL;
+
+/* c = a*b with the algorithm selected */
+static void multiply(void)
+{
+	switch (algo) {
+	case PARALLEL:
+		ParTiledMult(a, b, c);	// tiles distributed over threads
+		break;
+	case NUMA:
+		NumaTiledMult(a, b, c);	// node-local tiles first
+		break;
+	default:
+		TiledMult(a, b, c);	// tiled algorithm
+	}
+}
+
+/*
+ * time the leading m by k by n part of c = a*b with block size blk
+ * and threads threads, for Tune()
+ */
+static double trial(int blk, int threads, int m, int k, int n)
+{
+	matrix sa = a, sb = b;
+	accmatrix sc = c;
+	double t;
+
+	block = blk;
+	omp_set_num_threads(threads);
+	a = submatrix(sa, 0, 0, m, k);
+	b = submatrix(sb, 0, 0, k, n);
+	c = accsubmatrix(sc, 0, 0, m, n);
+	t = seconds();
+	multiply();
+	t = seconds() - t;
+	a = sa;
+	b = sb;
+	c = sc;
+	return t;
+}
+
 int main(int argc, char **argv) {
 	struct timeval ts,tf;
 	double tt;
-    	int n;
-    	matrix a, b, c;
-
-    	check(argc >= 3, "main: Need matrix size and block size on command line");
-    	n = atoi(argv[1]);
-	block=atoi(argv[2]);
-	check(n%block == 0, "main: Matrix size must be a multiple of block size");
+    	int m, k, n, opt, retune = 0, verify = 0, ok = 1;
+	char size[40], engine[64], *afile = NULL, *bfile = NULL;
+	tuning t;
+
+	while ((opt = getopt(argc, argv, "a:A:B:Tv")) != -1) {
+		switch (opt) {
+		case 'a':
+			for (algo = 0; algo < NALGOS; algo++)
+				if (!strcmp(optarg, algos[algo]))
+					break;
+			check(algo < NALGOS, "main: Unknown algorithm");
+			break;
+		case 'A':
+			afile = optarg;
+			break;
+		case 'B':
+			bfile = optarg;
+			break;
+		case 'v':
+			verify = 1;
+			break;
+		case 'T':
+			retune = 1;
+			break;
+		default:
+			check(0, "main: usage: tiled [-a serial|parallel|numa] [-T] [-v] {size | -A file -B file} [block]");
+		}
+	}
+	if (afile != NULL || bfile != NULL)
+		readoperands(afile, bfile, &a, &b);	/* size of the files */
+	else {
+		check(argc - optind >= 1, "main: Need matrix size on command line");
+		parsesize(argv[optind++], &m, &k, &n);
+		a = newmatrix(m, k);
+		b = newmatrix(k, n);
+		randomfill(a, SEEDA);
+		randomfill(b, SEEDB);
+	}
+	m = a.rows;
+	k = a.cols;
+	n = b.cols;
+	sizename(size, m, k, n);
+	block = argc - optind >= 1 ? atoi(argv[optind]) : 0;
+	c = newaccmatrix(m, n);
+
+	/*
+	 * Without a block size use the tuned one, tuning first if need be.
+	 * OMP_NUM_THREADS, if set, wins over the tuned thread count.
+	 */
+	if (block <= 0) {
+		int threads = omp_get_max_threads();
+
+		sprintf(engine, "tiled" ELEMSUFFIX "-%s", algos[algo]);
+		if (retune || !LoadTuning(engine, m, k, n, &t)) {
+			t = Tune(trial, m, k, n, algo != SERIAL ? threads : 1);
+			SaveTuning(engine, m, k, n, t);
+		}
+		block = t.block;
+		omp_set_num_threads(algo != SERIAL && getenv("OMP_NUM_THREADS") == NULL
+			? t.threads : threads);
+	}
 
-    	a = newmatrix(n);
-    	b = newmatrix(n);
-    	c = newmatrix(n);
-    	randomfill(n, a);
-   	randomfill(n, b);
+	/* place the operands for the final block size and team */
+	if (algo == NUMA) {
+		matrix na = NumaRows(a, block), nb = NumaSpread(b);
+		accmatrix nc = NumaAccRows(c, block);
+
+		freeoperand(a);
+		freeoperand(b);
+		freeaccmatrix(c);
+		a = na;
+		b = nb;
+		c = nc;
+	}
 
 	gettimeofday(&ts,NULL);
-	TiledMult(n, a, b, c);	// tiled algorithm 
+	multiply();
 	gettimeofday(&tf,NULL);
 	tt=(tf.tv_sec-ts.tv_sec)+(tf.tv_usec-ts.tv_usec)*0.000001;
 
-	printf("Tiled Size %d Block %d Time %lf\n",n,block,tt);
+	switch (algo) {
+	case PARALLEL:
+		printf("Parallel Tiled Size %s Block %d Threads %d Time %lf\n",size,block,omp_get_max_threads(),tt);
+		break;
+	case NUMA:
+		printf("NUMA Tiled Size %s Block %d Threads %d Nodes %d Time %lf\n",
+			size,block,omp_get_max_threads(),NumaNodes(),tt);
+		break;
+	default:
+		printf("Tiled Size %s Block %d Time %lf\n",size,block,tt);
+	}
 
-	char *filename=malloc(30*sizeof(char));
-	sprintf(filename,"res_mm_tiled_%d",n);
-	FILE * f=fopen(filename,"w");
-	print(c,n,f);
-	fclose(f);
+	writeresult(c,"tiled",size);
+	if (verify)
+		ok = Verify(a, b, c);
 
-	freematrix(a,n);
-	freematrix(b,n);
-	freematrix(c,n);	
-    	return 0;
+	freeoperand(a);
+	freeoperand(b);
+	freeaccmatrix(c);
+    	return ok ? 0 : 1;
 }
 
-/* c = a*b */
-void TiledMult(int n, matrix a, matrix b, matrix c)
+/* c = a*b of tiles, or c = c + a*b after the first one of the k loop */
+static inline void TileMult(matrix a, matrix b, accmatrix c, int k)
 {
-	int i, j, k;
-
-
-	if (n <= block) 
-    		SerialMult(block, a, b, c);
-	else {
-		for (i=0;i<n/block;i++)
-			for (j=0;j<n/block;j++)
-				for (k=0;k<n/block;k++) 
-					SerialMult(block,a->p[i][k],b->p[k][j],c->p[i][j]);
-	}
+	if (k > 0)
+		LeafMultAdd(a, b, c);
+	else
+		LeafMult(a, b, c);
 }
 
-void SerialMult(int n, matrix a, matrix b, matrix c) {
-	double **p, ** q, ** r;
-	int i, j, k;
-	p = a->d, q = b->d, r = c->d;
-	for (i = 0; i < n; i++) 
-	    	for (j = 0; j < n; j++) 
-			for (k = 0; k < n; k++)
-			    	r[i][j] += p[i][k] * q[k][j];
-}
+/* c = a*b */
+void TiledMult(matrix a, matrix b, accmatrix c)
+{
+	int i, j, k, mb = NTILES(c.rows), nb = NTILES(c.cols), kb = NTILES(a.cols);
 
 
-/*Tiled randomfill---Possibly useful on NUMA archs*/
-/* Fill the matrix a with random values between 0 and 1 */
-/*
-void randomfill(int n, matrix a) {
-	int i, j;
-	if (n <= block) {
-
-		double **q =a->d;
-		double T = -(double)(1 << 31);
-		for (i = 0; i < n; i++)
-			for (j = 0; j < n; j++)
-				a->d[i][j] = random() / T; 
-	} 
+	if (mb == 1 && nb == 1 && kb == 1) 
+    		LeafMult(a, b, c);
 	else {
-		for (i=0;i<n/block;i++)
-			for (j=0;j<n/block;j++)
-				randomfill(block,a->p[i][j]);		
+		for (i=0;i<mb;i++)
+			for (j=0;j<nb;j++)
+				for (k=0;k<kb;k++) 
+					TileMult(TILE(a,i,k), TILE(b,k,j), ACCTILE(c,i,j), k);
 	}
 }
 
-*/
-
-/* Fill the matrix a with random values between 0 and 1 */
-void randomfill(int n, matrix a) {
-	int i, j;
-	double T = -(double)(1 << 31);
-
-    	if (n <= block) {
-		double **p=a->d;
-		for (i = 0; i < n; i++)
-	    		for (j = 0; j < n; j++)
-				p[i][j] = random() / T;
-    	} 
-	else {
-		for (i=0;i<n;i++)
-			for (j=0;j<n;j++) 
-				a->p[i/block][j/block]->d[i%block][j%block]=random() / T;
-    	}
-}
-
-/* return new square n by n matrix */
-matrix newmatrix(int n) {
-
-	matrix a;
-    	a = (matrix)malloc(sizeof(*a));
-    	check(a != NULL, "newmatrix: out of space for matrix");
-    	if (n <= block) {
-		int i;
-		a->d = (double **)calloc(n, sizeof(double *));
-		check(a->d != NULL,
-			"newmatrix: out of space for row pointers");
-		for (i = 0; i < n; i++) {
-	    		a->d[i] = (double *)calloc(n, sizeof(double));
-		    	check(a != NULL, "newmatrix: out of space for rows");
-		}
-    	} 
-	else {
-		int i,j;
-		a->p = (matrix **)calloc(n/block, sizeof(matrix*));
-		check(a->p != NULL,
-			"newmatrix: out of space for submatrices");
-		for (i=0;i<n/block;i++) {
-			a->p[i] = (matrix*)calloc(n/block,sizeof(matrix));
-			check(a->p[i] != NULL,
-				"newmatrix: out of space for submatrices");
-		}
-		
-		for (i=0;i<n/block;i++)
-			for (j=0;j<n/block;j++) 
-				a->p[i][j]=newmatrix(block);
-    	} 
-	return a;
-}
+/*
+ * c = a*b, with the (i,j) tiles of c distributed over the threads.
+ * Each thread runs the whole k loop of the tiles it owns, so no two
+ * threads ever write the same tile and no locking is needed.
+ */
+void ParTiledMult(matrix a, matrix b, accmatrix c)
+{
+	int i, j, k, mb = NTILES(c.rows), nb = NTILES(c.cols), kb = NTILES(a.cols);
 
-/* free square n by n matrix m */
-void freematrix (matrix m, int n) {
-	if (n<=block) {
-		int i;
-		for (i=0;i<n;i++)
-			free(m->d[i]);
-		free(m->d);
-	}
-	else {
-		int i,j;
-		for (i=0;i<n/block;i++)
-			for (j=0;j<n/block;j++)
-				freematrix(m->p[i][j],block);
+	if (mb == 1 && nb == 1 && kb == 1) {
+		LeafMult(a, b, c);
+		return;
 	}
-}
 
-
-void print (matrix a, int n, FILE * f) {
-	int i,j;
-	if (n<=block) {
-		double **p=a->d;
-		for (i=0;i<n;i++) {
-			for (j=0;j<n;j++)
-				fprintf(f,"%lf ",p[i][j]);
-			fprintf(f,"\n");
-		}
-	}
-	else {
-		for (i=0;i<n;i++) {
-			for (j=0;j<n;j++) 
-				fprintf(f,"%lf ", a->p[i/block][j/block]->d[i%block][j%block]);
-			fprintf(f,"\n");
-		}
-	}
+	#pragma omp parallel for collapse(2) schedule(static) private(k)
+	for (i=0;i<mb;i++)
+		for (j=0;j<nb;j++)
+			for (k=0;k<kb;k++)
+				TileMult(TILE(a,i,k), TILE(b,k,j), ACCTILE(c,i,j), k);
 }
 
-
 /*
- * If the expression e is false print the error message s and quit. 
+ * c = a*b with a and c placed by NumaRows() in bands of tile rows, one
+ * per node.  Every node has a queue of the (i,j) tiles of c in its
+ * band, a counter the threads of the team take tiles from one at a
+ * time.  A thread, bound to its node, empties the queue of its own
+ * node first and then helps with those of the others, so tiles are
+ * computed where their a and c live unless the load is uneven.
  */
-
-void check(int e, char *s)
+void NumaTiledMult(matrix a, matrix b, accmatrix c)
 {
-    if (!e) {
-		fprintf(stderr, "Fatal error -> %s\n", s);
-		exit(1);
-    }
+	int mb = NTILES(c.rows), nb = NTILES(c.cols), kb = NTILES(a.cols);
+	int nodes = NumaNodes(), *next, *end;
+
+	/* counters a cache line apart */
+	next = malloc(nodes * MM_ALIGN);
+	end = malloc(nodes * sizeof(int));
+	check(next != NULL && end != NULL, "NumaTiledMult: out of space");
+
+	#pragma omp parallel
+	{
+		int d, e, s, x, i, j, k;
+
+		#pragma omp single
+		for (d = 0; d < nodes; d++) {
+			next[d * MM_ALIGN / sizeof(int)] = NumaFirst(d, omp_get_num_threads(), mb) * nb;
+			end[d] = NumaFirst(d + 1, omp_get_num_threads(), mb) * nb;
+		}
+		NumaBind();
+		d = NumaNode(omp_get_thread_num(), omp_get_num_threads());
+		for (s = 0; s < nodes; s++) {
+			e = (d + s) % nodes;
+			for (;;) {
+				#pragma omp atomic capture
+				x = next[e * MM_ALIGN / sizeof(int)]++;
+				if (x >= end[e])
+					break;
+				i = x / nb;
+				j = x % nb;
+				for (k = 0; k < kb; k++)
+					TileMult(TILE(a,i,k), TILE(b,k,j), ACCTILE(c,i,j), k);
+			}
+		}
+	}
+	free(next);
+	free(end);
 }
-
-
-
-
-
-
-
@@ -4,13 +4,40 @@
  * Header file for tiled matrix multiplication functions.
  */
 
+#include "mm_matrix.h"
+#include "mm_kernel.h"
 
-typedef union _matrix {
-    double **d;
-    union _matrix ***p;
-} *matrix;
+extern int block;
 
-void TiledMult(int, matrix, matrix, matrix);
-void SerialMult(int, matrix, matrix, matrix);
+/*
+ * Tiles are block by block views into the contiguous matrices, so the
+ * (i,j) tile of a is simply TILE(a,i,j) and no per-tile storage exists.
+ * When a dimension is not a multiple of block the tiles of the last
+ * row or column are ragged, i.e. only as large as what is left, and
+ * NTILES() of each dimension counts the tiles along it.
+ */
+
+#define TILE(a, i, j) tile(a, i, j)
+#define ACCTILE(c, i, j) acctile(c, i, j)
+#define NTILES(n) (((n) + block - 1) / block)
+
+static inline matrix tile(matrix a, int i, int j)
+{
+	int rows = a.rows - i * block, cols = a.cols - j * block;
+
+	return submatrix(a, i * block, j * block,
+		rows < block ? rows : block, cols < block ? cols : block);
+}
+
+/* same as tile() for results */
+static inline accmatrix acctile(accmatrix c, int i, int j)
+{
+	int rows = c.rows - i * block, cols = c.cols - j * block;
 
+	return accsubmatrix(c, i * block, j * block,
+		rows < block ? rows : block, cols < block ? cols : block);
+}
 
+void TiledMult(matrix, matrix, accmatrix);
+void ParTiledMult(matrix, matrix, accmatrix);
+void NumaTiledMult(matrix, matrix, accmatrix);	/* node-local tiles first */
@@ -0,0 +1,196 @@
+/*
+ * mm_tune.c
+ *
+ * Autotuning of the block size and thread count of the tiled,
+ * recursive and Strassen engines.  Tune() times the program's own
+ * product for every pair of candidates,
+ *
+ *	block sizes	TUNEMIN, 2*TUNEMIN, ... TUNEMAX
+ *	threads		1, 2, 4, ... and all available
+ *
+ * and keeps the fastest.  Products of more than TUNEWORK multiply-adds
+ * are timed on their leading part only, with the longest side halved
+ * until it is that small, so tuning a large product costs about as
+ * much as tuning one of 1024^3.  Results go to a tuning file, mm_tuning in
+ * the current directory unless the environment variable MM_TUNEFILE
+ * names another, with one line per entry:
+ *
+ *	engine class block threads cpu
+ *
+ * engine names the program, element type and algorithm, such as
+ * tiled_f-parallel, class is SizeClass() of the product and cpu the
+ * model name of the processor, so that one file can serve machines of
+ * several kinds.  The programs look their entry up whenever no block
+ * size is given on the command line, and tune and add it if there is
+ * none.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "mm_tune.h"
+
+#define TUNEMIN 16
+#define TUNEMAX 256
+#define TUNEWORK (1L << 30)		/* largest trial, in multiply-adds */
+#define TUNEFILE "mm_tuning"
+#define LINE 512
+
+static char model[256];
+
+/* seconds since the epoch */
+double seconds(void)
+{
+	struct timeval t;
+
+	gettimeofday(&t, NULL);
+	return t.tv_sec + t.tv_usec * 0.000001;
+}
+
+/* model name of the processor as /proc/cpuinfo tells, or "unknown" */
+char *CpuModel(void)
+{
+	char line[LINE], *p;
+	FILE *f;
+
+	if (model[0] != 0)
+		return model;
+	strcpy(model, "unknown");
+	if ((f = fopen("/proc/cpuinfo", "r")) == NULL)
+		return model;
+	while (fgets(line, LINE, f) != NULL)
+		if (!strncmp(line, "model name", 10) && (p = strchr(line, ':')) != NULL) {
+			p += 1 + strspn(p + 1, " \t");
+			p[strcspn(p, "\n")] = 0;
+			if (*p != 0)
+				snprintf(model, sizeof(model), "%s", p);
+			break;
+		}
+	fclose(f);
+	return model;
+}
+
+/*
+ * Size class of an m by k by n product: the smallest power of two at
+ * least the side of a cube of mkn elements, so that products of about
+ * the same work share their tuning.
+ */
+int SizeClass(int m, int k, int n)
+{
+	double work = (double)m * k * n;
+	int s = 1;
+
+	while ((double)s * s * s < work)
+		s *= 2;
+	return s;
+}
+
+static char *tuningfile(void)
+{
+	char *file = getenv("MM_TUNEFILE");
+
+	return file != NULL && *file != 0 ? file : TUNEFILE;
+}
+
+/* does line hold the entry for engine, size class and this cpu? */
+static int entry(char *line, char *engine, int class, tuning *t)
+{
+	char name[LINE], cpu[LINE];
+	int c;
+
+	return line[0] != '#'
+		&& sscanf(line, "%s %d %d %d %[^\n]", name, &c, &t->block, &t->threads, cpu) == 5
+		&& !strcmp(name, engine) && c == class && !strcmp(cpu, CpuModel());
+}
+
+/*
+ * look up the tuning of engine for an m by k by n product, 1 if found;
+ * an entry with a block size or thread count below 1 counts as none
+ */
+int LoadTuning(char *engine, int m, int k, int n, tuning *t)
+{
+	char line[LINE];
+	int found = 0, class = SizeClass(m, k, n);
+	tuning e;
+	FILE *f;
+
+	if ((f = fopen(tuningfile(), "r")) == NULL)
+		return 0;
+	while (!found && fgets(line, LINE, f) != NULL)
+		if (entry(line, engine, class, &e) && e.block > 0 && e.threads > 0) {
+			*t = e;
+			found = 1;
+		}
+	fclose(f);
+	return found;
+}
+
+/* record t as the tuning of engine for an m by k by n product */
+void SaveTuning(char *engine, int m, int k, int n, tuning t)
+{
+	char line[LINE], *keep = NULL;
+	size_t len = 0, l;
+	int class = SizeClass(m, k, n);
+	tuning e;
+	FILE *f;
+
+	/* all other entries stay */
+	if ((f = fopen(tuningfile(), "r")) != NULL) {
+		while (fgets(line, LINE, f) != NULL)
+			if (!entry(line, engine, class, &e)) {
+				l = strlen(line);
+				keep = realloc(keep, len + l + 1);
+				check(keep != NULL, "SaveTuning: out of space");
+				memcpy(keep + len, line, l + 1);
+				len += l;
+			}
+		fclose(f);
+	}
+
+	f = fopen(tuningfile(), "w");
+	check(f != NULL, "SaveTuning: cannot write tuning file");
+	if (keep != NULL)
+		fputs(keep, f);
+	fprintf(f, "%s %d %d %d %s\n", engine, class, t.block, t.threads, CpuModel());
+	fclose(f);
+	free(keep);
+}
+
+/*
+ * Time run for every candidate block size up to the longest side of
+ * the trials (but at least TUNEMIN) and thread count up to maxthreads,
+ * and return the fastest.  The trials multiply the leading m by k by n
+ * part of the product, cut down to at most TUNEWORK multiply-adds.
+ */
+tuning Tune(timedmult run, int m, int k, int n, int maxthreads)
+{
+	tuning best = { TUNEMIN, 1 };
+	double t, tbest = -1;
+	int block, threads, maxblock, *side;
+
+	while ((double)m * k * n > TUNEWORK) {
+		side = m >= k && m >= n ? &m : k >= n ? &k : &n;
+		*side = (*side + 1) / 2;
+	}
+	maxblock = m > k ? (m > n ? m : n) : (k > n ? k : n);
+
+	run(best.block, best.threads, m, k, n);	/* warm up, page in the operands */
+	for (threads = 1; ; threads *= 2) {
+		if (threads > maxthreads)
+			threads = maxthreads;
+		for (block = TUNEMIN; block <= TUNEMAX; block *= 2) {
+			if (block > TUNEMIN && block > maxblock)
+				break;
+			t = run(block, threads, m, k, n);
+			if (tbest < 0 || t < tbest) {
+				tbest = t;
+				best.block = block;
+				best.threads = threads;
+			}
+		}
+		if (threads >= maxthreads)
+			break;
+	}
+	return best;
+}
@@ -0,0 +1,40 @@
+/*
+ * mm_tune.h
+ *
+ * Header file for the autotuner of block sizes and thread counts.
+ */
+
+#ifndef MM_TUNE_H
+#define MM_TUNE_H
+
+#include "mm_matrix.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* parameters found for one engine, machine and size class */
+typedef struct _tuning {
+	int block;		/* block size, or crossover of the hybrid engine */
+	int threads;		/* threads of the parallel engines */
+} tuning;
+
+/*
+ * A trial multiplies the leading m by k by n part of the operands of
+ * the program with the given block size and number of threads and
+ * returns the time it took in seconds.
+ */
+typedef double (*timedmult)(int, int, int, int, int);
+
+tuning Tune(timedmult, int, int, int, int);	/* best for m, k, n, up to threads */
+int LoadTuning(char *, int, int, int, tuning *);	/* entry for engine, m, k, n */
+void SaveTuning(char *, int, int, int, tuning);	/* add or replace that entry */
+char *CpuModel(void);		/* name of the processor */
+int SizeClass(int, int, int);	/* size class of an m by k by n product */
+double seconds(void);		/* wall clock time */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MM_TUNE_H */
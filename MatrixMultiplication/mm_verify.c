@@ -0,0 +1,228 @@
+/*
+ * mm_verify.c
+ *
+ * Verification of a product c = a*b, for the -v option of the
+ * programs, instead of comparing result files.  Products of up to
+ * VERIFYREF multiply-adds are checked against a reference computed row
+ * by row in double precision (exactly for int8); larger ones with
+ * Freivalds' test, which compares c*x with a*(b*x) for a random vector
+ * x in O(mk + kn + mn) operations.  A wrong element of c shows in c*x
+ * unless its x_j happens to be zero.
+ *
+ * Rounding is not the same for all engines, Strassen's least of all,
+ * so the results are compared to a tolerance scaled by the norms of
+ * the operands.  The classical bound on the error of an inner product
+ * of length k is k*u*|a_i|.|b_j| for unit roundoff u, and |a_i|.|b_j|
+ * is at most the product of the norms of row i and column j, which is
+ * s = ||a||_F * ||b||_F / sqrt(mn) for rows and columns of average
+ * norm, hence
+ *
+ *	max |c - a*b| <= VERIFYTOL * k * u * s
+ *
+ * Freivalds' test sums n such errors, of random sign, times x, and
+ * rounds in sums of length k and n, so it allows VERIFYTOL * (k+n) *
+ * u * s * ||x||_2.  int8 products are exact and must match exactly.
+ *
+ * Strassen's recursion does not meet the bound of inner products; its
+ * error grows with the levels of recursion.  Higham's bound grows by
+ * 12 per level, or 18 for Winograd's variant, against 4 for classical
+ * products of twice the size, but is far from attained: in practice the
+ * error about doubles per level.  VerifyStrassen() therefore widens the
+ * tolerance by STRASSENGROWTH for each level above the classical leaves.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <complex.h>
+#include "mm_verify.h"
+
+#define VERIFYTOL 4			/* tolerance in units of the bound */
+#define VERIFYREF (1L << 27)		/* largest m*k*n checked by reference */
+#define SEEDX 3				/* seed of Freivalds' vector */
+#define STRASSENGROWTH 2		/* growth of Strassen's error per level */
+
+/* type of the reference sums */
+#if defined(MM_INT8)
+typedef long long wide;
+#elif defined(MM_COMPLEX)
+typedef double _Complex wide;
+#else
+typedef double wide;
+#endif
+
+static inline double mag(wide x)
+{
+#if defined(MM_INT8)
+	return llabs(x);
+#elif defined(MM_COMPLEX)
+	return cabs(x);
+#else
+	return fabs(x);
+#endif
+}
+
+/* the larger error of e and d, infinite if d is NaN */
+static inline double worse(double e, double d)
+{
+	return isnan(d) ? INFINITY : d > e ? d : e;
+}
+
+/* unit roundoff of the computation, 0 for exact integers */
+static double roundoff(void)
+{
+#if defined(MM_INT8)
+	return 0;
+#elif defined(MM_FLOAT)
+	return FLT_EPSILON / 2;
+#else
+	return DBL_EPSILON / 2;
+#endif
+}
+
+/* Frobenius norm of a */
+static double frobenius(matrix a)
+{
+	double s = 0;
+	long i;
+
+	#pragma omp parallel for reduction(+:s) schedule(static)
+	for (i = 0; i < a.rows; i++) {
+		elem *p = ROW(a, i);
+		int j;
+
+		for (j = 0; j < a.cols; j++)
+			s += mag(p[j]) * mag(p[j]);
+	}
+	return sqrt(s);
+}
+
+/*
+ * Largest difference between c and the reference product a*b, and
+ * largest element of the reference, each row of which is computed in
+ * a scratch row of the thread.
+ */
+static void reference(matrix a, matrix b, accmatrix c, double *err, double *max)
+{
+	double e = 0, r = 0;
+	long i;
+
+	#pragma omp parallel reduction(max:e, r)
+	{
+		wide *row = malloc(c.cols * sizeof(wide));
+		int j, p;
+
+		check(row != NULL, "reference: out of space");
+		#pragma omp for schedule(static)
+		for (i = 0; i < c.rows; i++) {
+			memset(row, 0, c.cols * sizeof(wide));
+			for (p = 0; p < a.cols; p++) {
+				wide x = ELEM(a, i, p);
+				elem *q = ROW(b, p);
+
+				for (j = 0; j < c.cols; j++)
+					row[j] += x * q[j];
+			}
+			for (j = 0; j < c.cols; j++) {
+				e = worse(e, mag(ELEM(c, i, j) - row[j]));
+				r = fmax(r, mag(row[j]));
+			}
+		}
+		free(row);
+	}
+	*err = e;
+	*max = r;
+}
+
+/*
+ * Freivalds' test: largest difference between c*x and a*(b*x), and
+ * largest element of a*(b*x), for the random vector x of SEEDX, whose
+ * norm goes to *norm.
+ */
+static void freivalds(matrix a, matrix b, accmatrix c, double *err, double *max,
+	double *norm)
+{
+	matrix v = newmatrix(1, b.cols);
+	wide *x = malloc(b.cols * sizeof(wide)), *y = malloc(b.rows * sizeof(wide));
+	double e = 0, r = 0, s = 0;
+	long i;
+	int j;
+
+	check(x != NULL && y != NULL, "freivalds: out of space");
+	randomfill(v, SEEDX);
+	for (j = 0; j < b.cols; j++) {
+#ifdef MM_INT8
+		x[j] = ELEM(v, 0, j) + 129;	/* never 0 */
+#else
+		x[j] = ELEM(v, 0, j);
+#endif
+		s += mag(x[j]) * mag(x[j]);
+	}
+
+	/* y = b*x */
+	#pragma omp parallel for private(j) schedule(static)
+	for (i = 0; i < b.rows; i++) {
+		wide t = 0;
+
+		for (j = 0; j < b.cols; j++)
+			t += ELEM(b, i, j) * x[j];
+		y[i] = t;
+	}
+
+	/* a*y against c*x */
+	#pragma omp parallel for private(j) reduction(max:e, r) schedule(static)
+	for (i = 0; i < a.rows; i++) {
+		wide ay = 0, cx = 0;
+
+		for (j = 0; j < a.cols; j++)
+			ay += ELEM(a, i, j) * y[j];
+		for (j = 0; j < c.cols; j++)
+			cx += ELEM(c, i, j) * x[j];
+		e = worse(e, mag(cx - ay));
+		r = fmax(r, mag(ay));
+	}
+
+	freematrix(v);
+	free(x);
+	free(y);
+	*err = e;
+	*max = r;
+	*norm = sqrt(s);
+}
+
+/*
+ * Check c = a*b, by reference or Freivalds' test as the size says,
+ * print the largest absolute and relative error and the tolerance, and
+ * return 1 if the error is within the tolerance.
+ */
+int Verify(matrix a, matrix b, accmatrix c)
+{
+	return VerifyStrassen(a, b, c, 0);
+}
+
+/* same as Verify() for c of levels of Strassen recursion */
+int VerifyStrassen(matrix a, matrix b, accmatrix c, int levels)
+{
+	double err, max, norm = 1, tol, s;
+	int m = c.rows, k = a.cols, n = c.cols, ok, ref = (double)m * k * n <= VERIFYREF;
+
+	check(a.rows == m && b.rows == k && b.cols == n, "Verify: nonconformant matrices");
+	if (ref)
+		reference(a, b, c, &err, &max);
+	else
+		freivalds(a, b, c, &err, &max, &norm);
+	s = frobenius(a) * frobenius(b) / sqrt((double)m * n);
+	if (ref)
+		tol = VERIFYTOL * k * roundoff() * s;
+	else
+		tol = VERIFYTOL * (double)(k + n) * roundoff() * s * norm;
+	tol *= pow(STRASSENGROWTH, levels);
+	ok = err <= tol;
+
+	printf("Verify %s MaxAbs %e MaxRel %e Tolerance %e %s\n",
+		ref ? "Reference" : "Freivalds", err, max > 0 ? err / max : err, tol,
+		ok ? "OK" : "FAILED");
+	return ok;
+}
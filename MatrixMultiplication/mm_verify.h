@@ -0,0 +1,23 @@
+/*
+ * mm_verify.h
+ *
+ * Header file for the verification of products.
+ */
+
+#ifndef MM_VERIFY_H
+#define MM_VERIFY_H
+
+#include "mm_matrix.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int Verify(matrix, matrix, accmatrix);	/* check c = a*b, report, 1 if it holds */
+int VerifyStrassen(matrix, matrix, accmatrix, int);	/* same, levels of Strassen */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MM_VERIFY_H */